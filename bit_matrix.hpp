@@ -0,0 +1,143 @@
+#ifndef BIT_MATRIX_HPP
+#define BIT_MATRIX_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// The packed sketch x hash bit matrix and its BITCSC01 export, shared by compute_bit_representation and
+// compute_by_gpu so both write the same format.
+
+
+// sketches x distinct hashes bit matrix, packed into 64-bit words and stored in column blocks:
+// block b holds columns [b * BLOCK_COLUMNS, (b + 1) * BLOCK_COLUMNS) as num_rows runs of WORDS_PER_BLOCK words,
+// so a popcount/GEMM tile or an exporter can walk one block at a time with contiguous rows
+class PackedBitMatrix {
+public:
+    static const size_t WORDS_PER_BLOCK = 64;
+    static const size_t BLOCK_COLUMNS = WORDS_PER_BLOCK * 64;
+
+    size_t num_rows;
+    size_t num_cols;
+    size_t num_blocks;
+    std::vector<unsigned long long int> column_hashes; // hash value of each column, sorted
+    std::vector<uint64_t> words;
+
+    PackedBitMatrix(size_t rows, std::vector<unsigned long long int> hashes)
+        : num_rows(rows), num_cols(hashes.size()), column_hashes(std::move(hashes)) {
+        num_blocks = (num_cols + BLOCK_COLUMNS - 1) / BLOCK_COLUMNS;
+        words.assign(num_blocks * num_rows * WORDS_PER_BLOCK, 0);
+    }
+
+    // the WORDS_PER_BLOCK words of one row inside one column block
+    const uint64_t* rowBlock(size_t row, size_t block) const {
+        return words.data() + (block * num_rows + row) * WORDS_PER_BLOCK;
+    }
+
+    void set(size_t row, size_t col) {
+        size_t block = col / BLOCK_COLUMNS;
+        size_t offset = col % BLOCK_COLUMNS;
+        words[(block * num_rows + row) * WORDS_PER_BLOCK + offset / 64] |= 1ULL << (offset % 64);
+    }
+
+    bool get(size_t row, size_t col) const {
+        size_t offset = col % BLOCK_COLUMNS;
+        return (rowBlock(row, col / BLOCK_COLUMNS)[offset / 64] >> (offset % 64)) & 1ULL;
+    }
+};
+
+
+
+// build the packed bit representation directly: columns are the sorted distinct hashes, and only set bits are written
+inline PackedBitMatrix createBitRepresentation(const std::vector<std::vector<unsigned long long int>>& inputLists) {
+    std::vector<unsigned long long int> column_hashes;
+    for (const auto& list : inputLists) {
+        column_hashes.insert(column_hashes.end(), list.begin(), list.end());
+    }
+    std::sort(column_hashes.begin(), column_hashes.end());
+    column_hashes.erase(std::unique(column_hashes.begin(), column_hashes.end()), column_hashes.end());
+
+    PackedBitMatrix bitRepresentation(inputLists.size(), std::move(column_hashes));
+    const auto& columns = bitRepresentation.column_hashes;
+
+    // every list is sorted, so the column search for the next hash starts where the last one ended
+    for (size_t i = 0; i < inputLists.size(); i++) {
+        auto it = columns.begin();
+        for (auto hash : inputLists[i]) {
+            it = std::lower_bound(it, columns.end(), hash);
+            bitRepresentation.set(i, it - columns.begin());
+        }
+    }
+
+    return bitRepresentation;
+}
+
+
+
+// export the bit matrix in compressed sparse column form, streamed one column block at a time.
+// layout (little-endian): "BITCSC01", num_rows (u64), num_cols (u64), nnz (u64),
+// column hashes (u64 x num_cols), column pointers (u64 x num_cols+1), row ids (u32 x nnz)
+inline void writeCSC(const PackedBitMatrix& bitRepresentation, const std::string& filename) {
+    std::ofstream outfile(filename, std::ios::binary);
+    if (!outfile.is_open()) {
+        std::cerr << "Could not open the file: " << filename << std::endl;
+        return;
+    }
+
+    const size_t block_columns = PackedBitMatrix::BLOCK_COLUMNS;
+
+    // first pass: number of set bits in every column
+    std::vector<uint64_t> column_pointers(bitRepresentation.num_cols + 1, 0);
+    for (size_t b = 0; b < bitRepresentation.num_blocks; b++) {
+        for (size_t r = 0; r < bitRepresentation.num_rows; r++) {
+            const uint64_t* row_words = bitRepresentation.rowBlock(r, b);
+            for (size_t w = 0; w < PackedBitMatrix::WORDS_PER_BLOCK; w++) {
+                for (uint64_t bits = row_words[w]; bits; bits &= bits - 1) {
+                    column_pointers[b * block_columns + w * 64 + __builtin_ctzll(bits) + 1]++;
+                }
+            }
+        }
+    }
+    for (size_t c = 0; c < bitRepresentation.num_cols; c++) {
+        column_pointers[c + 1] += column_pointers[c];
+    }
+    uint64_t nnz = column_pointers[bitRepresentation.num_cols];
+
+    uint64_t num_rows = bitRepresentation.num_rows;
+    uint64_t num_cols = bitRepresentation.num_cols;
+    outfile.write("BITCSC01", 8);
+    outfile.write((const char*)&num_rows, sizeof(num_rows));
+    outfile.write((const char*)&num_cols, sizeof(num_cols));
+    outfile.write((const char*)&nnz, sizeof(nnz));
+    outfile.write((const char*)bitRepresentation.column_hashes.data(), num_cols * sizeof(unsigned long long int));
+    outfile.write((const char*)column_pointers.data(), column_pointers.size() * sizeof(uint64_t));
+
+    // second pass: row ids of one block at a time, rows come out sorted inside each column
+    std::vector<uint32_t> row_ids;
+    std::vector<uint64_t> fill;
+    for (size_t b = 0; b < bitRepresentation.num_blocks; b++) {
+        size_t first_col = b * block_columns;
+        size_t last_col = std::min(first_col + block_columns, bitRepresentation.num_cols);
+        uint64_t base = column_pointers[first_col];
+        row_ids.assign(column_pointers[last_col] - base, 0);
+        fill.assign(column_pointers.begin() + first_col, column_pointers.begin() + last_col);
+
+        for (size_t r = 0; r < bitRepresentation.num_rows; r++) {
+            const uint64_t* row_words = bitRepresentation.rowBlock(r, b);
+            for (size_t w = 0; w < PackedBitMatrix::WORDS_PER_BLOCK; w++) {
+                for (uint64_t bits = row_words[w]; bits; bits &= bits - 1) {
+                    size_t c = w * 64 + __builtin_ctzll(bits);
+                    row_ids[fill[c]++ - base] = r;
+                }
+            }
+        }
+        outfile.write((const char*)row_ids.data(), row_ids.size() * sizeof(uint32_t));
+    }
+
+    outfile.close();
+}
+
+#endif
@@ -0,0 +1,216 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+
+#include "similar_edges.hpp"
+#include "sketch_info.hpp"
+#include "text_output.hpp"
+#include "thread_pool.hpp"
+
+using namespace std;
+
+
+// connected components (single-linkage clusters) of the similar pairs written by compute_by_all_hashes.
+// the edges are streamed from the similarity files straight into a concurrent union-find, never stored
+
+
+int num_sketches;
+int num_threads = 1;
+vector<string> sketch_names;
+vector<int> sketch_sizes;
+
+// union-find forest. a parent always has a smaller id than its child, so the root of a tree is the
+// smallest genome id in it, and parents only ever decrease, which keeps the lock-free updates safe
+vector<atomic<int>> parent;
+
+
+
+int find_root(int x) {
+    while (true) {
+        int p = parent[x].load(memory_order_relaxed);
+        if (p == x) {
+            return x;
+        }
+        int grandparent = parent[p].load(memory_order_relaxed);
+        if (grandparent != p) {
+            // path halving; losing the race only means another thread already moved x closer to the root
+            parent[x].compare_exchange_weak(p, grandparent, memory_order_relaxed);
+        }
+        x = grandparent;
+    }
+}
+
+
+
+void unite(int a, int b) {
+    while (true) {
+        a = find_root(a);
+        b = find_root(b);
+        if (a == b) {
+            return;
+        }
+        // link the larger root under the smaller one; fails if a stopped being a root meanwhile, then retry
+        if (a < b) {
+            swap(a, b);
+        }
+        int expected = a;
+        if (parent[a].compare_exchange_strong(expected, b, memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+
+
+// every line, blank ones included: compute_by_all_hashes and post_process number the sketches by their
+// line in the sketch list, so dropping a line would shift every later genome id
+vector<string> read_lines(const string& filename) {
+    ifstream file(filename);
+    if (!file.is_open()) {
+        cerr << "Could not open the file: " << filename << endl;
+        exit(1);
+    }
+    vector<string> lines;
+    string line;
+    while (getline(file, line)) {
+        lines.push_back(line);
+    }
+    file.close();
+    return lines;
+}
+
+
+
+int main(int argc, char* argv[]) {
+
+    // command line arguments: sigFileList simFileList numThreads outFileName [sketchInfoFile] [options]
+    if (argc < 5) {
+        cerr << "Usage: " << argv[0] << " <sigFileList> <simFileList> <numThreads> <outFileName> [sketchInfoFile] [options]" << endl;
+        cerr << "  writes genome_id,cluster_id,representative_id,sketch_path for every genome" << endl;
+        cerr << "  sketchInfoFile: sketch_info.tsv written by compute_by_all_hashes; with it the representative" << endl;
+        cerr << "                  of a cluster is its genome with the largest sketch, otherwise its smallest genome id" << endl;
+        cerr << "  --min-containment V, --min-jaccard V, --min-ani V: only link pairs at or above the threshold" << endl;
+        cerr << "  --ksize K: k-mer size of the sketches, for --min-ani (default 31)" << endl;
+        return 1;
+    }
+
+    string sigFileList = argv[1];
+    string simFileList = argv[2];
+    num_threads = stoi(argv[3]);
+    string outFileName = argv[4];
+    string sketchInfoFile;
+    float min_containment = 0, min_jaccard = 0, min_ani = 0;
+    int ksize = 31;
+    for (int i = 5; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--min-containment" && i + 1 < argc) {
+            min_containment = stof(argv[++i]);
+        } else if (arg == "--min-jaccard" && i + 1 < argc) {
+            min_jaccard = stof(argv[++i]);
+        } else if (arg == "--min-ani" && i + 1 < argc) {
+            min_ani = stof(argv[++i]);
+        } else if (arg == "--ksize" && i + 1 < argc) {
+            ksize = stoi(argv[++i]);
+        } else if (arg.rfind("--", 0) == 0 || !sketchInfoFile.empty()) {
+            cerr << "Unknown argument: " << arg << endl;
+            return 1;
+        } else {
+            sketchInfoFile = arg;
+        }
+    }
+    // ani = containment^(1/k), so the ANI threshold is a containment threshold
+    if (min_ani > 0) {
+        min_containment = max(min_containment, (float)pow(min_ani, ksize));
+    }
+
+    auto start_program = chrono::high_resolution_clock::now();
+    sketch_names = read_lines(sigFileList);
+    num_sketches = sketch_names.size();
+    if (!sketchInfoFile.empty()) {
+        sketch_sizes = read_sketch_info(sketchInfoFile, num_sketches);
+    }
+    vector<string> filenames = read_lines(simFileList);
+
+    parent = vector<atomic<int>>(num_sketches);
+    for (int i = 0; i < num_sketches; i++) {
+        parent[i].store(i, memory_order_relaxed);
+    }
+
+    // stream the files into the forest, one task per file
+    Eigen::ThreadPool pool(num_threads);
+    atomic<long long> num_edges(0), num_linked(0);
+    run_tasks(pool, filenames.size(), [&](int f) {
+        long long edges_read = 0, edges_linked = 0;
+        for_each_similar_edge(filenames[f], [&](const SimilarEdge& edge) {
+            if (edge.id1 < 0 || edge.id1 >= num_sketches || edge.id2 < 0 || edge.id2 >= num_sketches) {
+                cerr << "Invalid genome id in " << filenames[f] << ": " << edge.id1 << "," << edge.id2 << endl;
+                exit(1);
+            }
+            edges_read++;
+            if (edge.containment < min_containment || edge.jaccard < min_jaccard) {
+                return;
+            }
+            edges_linked++;
+            unite(edge.id1, edge.id2);
+        });
+        num_edges += edges_read;
+        num_linked += edges_linked;
+    });
+
+    auto end_union = chrono::high_resolution_clock::now();
+    cout << "Linked " << num_linked << " of " << num_edges << " similar pairs from " << filenames.size() << " files" << endl;
+    cout << "Time taken to build the clusters: " << chrono::duration_cast<chrono::milliseconds>(end_union - start_program).count() << " milliseconds" << endl;
+
+    // flatten: the root of every genome, in parallel
+    vector<int> root(num_sketches);
+    parallel_for(pool, num_sketches, [&](long long i) {
+        root[i] = find_root(i);
+    });
+
+    // clusters are numbered in the order of their smallest genome id, so the ids do not depend on the thread count
+    vector<int> cluster_id(num_sketches, -1);
+    vector<int> representative;
+    vector<int> cluster_size;
+    for (int i = 0; i < num_sketches; i++) {
+        if (root[i] == i) {
+            cluster_id[i] = representative.size();
+            representative.push_back(i);
+            cluster_size.push_back(0);
+        }
+        int c = cluster_id[root[i]];
+        cluster_size[c]++;
+        if (!sketch_sizes.empty() && sketch_sizes[i] > sketch_sizes[representative[c]]) {
+            representative[c] = i;
+        }
+    }
+
+    int num_clusters = representative.size();
+    int num_singletons = count(cluster_size.begin(), cluster_size.end(), 1);
+    int largest_cluster = num_clusters > 0 ? *max_element(cluster_size.begin(), cluster_size.end()) : 0;
+    cout << "Number of clusters: " << num_clusters << " (" << num_singletons << " singletons, largest has " << largest_cluster << " genomes)" << endl;
+
+    // the paths of the sigFileList, as the genome ids index them
+    StringTable names;
+    for (const auto& name : sketch_names) {
+        names.add(name);
+    }
+    TextWriter outfile(outFileName);
+    outfile << "genome_id,cluster_id,representative_id,sketch_path\n";
+    for (int i = 0; i < num_sketches; i++) {
+        int c = cluster_id[root[i]];
+        outfile << i << ',' << c << ',' << representative[c] << ',' << names[i] << '\n';
+    }
+    outfile.close();
+
+    auto end_program = chrono::high_resolution_clock::now();
+    cout << "Total time: " << chrono::duration_cast<chrono::milliseconds>(end_program - start_program).count() << " milliseconds" << endl;
+
+    return 0;
+}
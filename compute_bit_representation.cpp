@@ -6,8 +6,14 @@
 #include <algorithm>
 #include <unordered_set>
 #include <fstream>
+#include <cstdint>
+#include <thread>
+#include <functional>
 
+#include "bit_matrix.hpp"
 #include "json.hpp"
+#include "npy_matrix.hpp"
+#include "text_output.hpp"
 
 #include <zlib.h>
 
@@ -107,13 +113,58 @@ public:
 
 
 
-std::vector<std::vector<unsigned long long int>> computeIntersectionMatrix(const std::vector<std::vector<unsigned long long int>>& inputLists) {
-    // create return list: an nxn matrix, where n is the number of input lists
-    std::vector<std::vector<unsigned long long int>> intersectionMatrix;
-    for (int i = 0; i < inputLists.size(); i++) {
-        intersectionMatrix.push_back(std::vector<unsigned long long int>(inputLists.size(), 0));
+// index of (i, j), i <= j, in a packed upper triangle of an n x n matrix
+inline unsigned long long int upperTriangleIndex(unsigned long long int i, unsigned long long int j, unsigned long long int n) {
+    return i * n - i * (i - 1) / 2 + (j - i);
+}
+
+
+
+// symmetric n x n intersection counts, stored as the packed upper triangle with 32-bit counts.
+// the jaccard of a pair is derived from the counts when needed instead of being stored
+class TriangularCountMatrix {
+public:
+    size_t n;
+    std::vector<uint32_t> counts;
+
+    TriangularCountMatrix(size_t n) : n(n), counts(n * (n + 1) / 2, 0) {}
+
+    uint32_t& at(size_t i, size_t j) {
+        return (i <= j) ? counts[upperTriangleIndex(i, j, n)] : counts[upperTriangleIndex(j, i, n)];
+    }
+
+    uint32_t get(size_t i, size_t j) const {
+        return (i <= j) ? counts[upperTriangleIndex(i, j, n)] : counts[upperTriangleIndex(j, i, n)];
+    }
+
+    // at(i, j)++ for threads counting into the same matrix
+    void incrementConcurrently(size_t i, size_t j) {
+        __atomic_fetch_add(&at(i, j), 1, __ATOMIC_RELAXED);
     }
 
+    size_t size() const {
+        return n;
+    }
+
+    double jaccard(size_t i, size_t j) const {
+        if (i == j) {
+            return 1.0;
+        }
+        unsigned long long int intersection = get(i, j);
+        unsigned long long int union_size = (unsigned long long int)get(i, i) + get(j, j) - intersection;
+        if (union_size == 0) {
+            return 0.0;
+        }
+        return 1.0 * intersection / union_size;
+    }
+};
+
+
+
+TriangularCountMatrix computeIntersectionMatrix(const std::vector<std::vector<unsigned long long int>>& inputLists) {
+    // create return matrix: the upper triangle of an nxn matrix, where n is the number of input lists
+    TriangularCountMatrix intersectionMatrix(inputLists.size());
+
     // create an array of indices to keep track of the current element of each list
     std::vector<int> indices(inputLists.size(), 0);
 
@@ -139,15 +190,14 @@ std::vector<std::vector<unsigned long long int>> computeIntersectionMatrix(const
 
             unsigned long int list_id1 = list_ids_where_this_element_a_member[i];
 
-            intersectionMatrix[list_id1][list_id1]++; // increment the intersection matrix for the same list
+            intersectionMatrix.at(list_id1, list_id1)++; // increment the intersection matrix for the same list
 
             // for each other list that contain this element
             for (unsigned long int j = i + 1; j < list_ids_where_this_element_a_member.size(); j++) {
 
                 unsigned long int list_id2 = list_ids_where_this_element_a_member[j];
 
-                intersectionMatrix[list_id1][list_id2]++;
-                intersectionMatrix[list_id2][list_id1]++;
+                intersectionMatrix.at(list_id1, list_id2)++;
             }
             
             // if the index is less than the size of the list, insert the element at that index into the heap
@@ -173,8 +223,8 @@ std::vector<std::vector<unsigned long long int>> computeIntersectionMatrix(const
 
         std::cout << "Intersection Matrix: " << std::endl;
         for (int i = 0; i < intersectionMatrix.size(); i++) {
-            for (int j = 0; j < intersectionMatrix[i].size(); j++) {
-                std::cout << intersectionMatrix[i][j] << " ";
+            for (int j = 0; j < intersectionMatrix.size(); j++) {
+                std::cout << intersectionMatrix.get(i, j) << " ";
             }
             std::cout << std::endl;
         }
@@ -205,70 +255,156 @@ std::vector<std::vector<unsigned long long int>> computeIntersectionMatrix(const
 
 
 
-std::vector<std::vector<bool>> createBitRepresentation(const std::vector<std::vector<unsigned long long int>>& inputLists) {
-    // create return list
-    std::vector<std::vector<bool>> bitRepresentation;
+// pick at most num_ranges - 1 splitters so that the hash space is cut into ranges of roughly equal work
+std::vector<unsigned long long int> sampleSplitters(const std::vector<std::vector<unsigned long long int>>& inputLists, int num_ranges) {
+    const int samples_per_range = 16;
+
+    std::vector<unsigned long long int> samples;
     for (int i = 0; i < inputLists.size(); i++) {
-        bitRepresentation.push_back(std::vector<bool>());
+        size_t stride = std::max((size_t)1, inputLists[i].size() / (num_ranges * samples_per_range));
+        for (size_t j = 0; j < inputLists[i].size(); j += stride) {
+            samples.push_back(inputLists[i][j]);
+        }
     }
+    std::sort(samples.begin(), samples.end());
 
-    // create an array of indices to keep track of the current element of each list
-    std::vector<int> indices(inputLists.size(), 0);
+    std::vector<unsigned long long int> splitters;
+    for (int t = 1; t < num_ranges && !samples.empty(); t++) {
+        unsigned long long int splitter = samples[samples.size() * t / num_ranges];
+        if (splitters.empty() || splitters.back() < splitter) {
+            splitters.push_back(splitter);
+        }
+    }
+    return splitters;
+}
+
+
+
+// merge the part of every list between begin_offsets[i] and end_offsets[i], counting pairs into a packed upper triangle,
+// with atomic increments when the triangle is shared with the threads merging the other ranges
+template <bool shared_counts>
+void mergeHashRange(const std::vector<std::vector<unsigned long long int>>& inputLists,
+                    const std::vector<size_t>& begin_offsets, const std::vector<size_t>& end_offsets,
+                    TriangularCountMatrix& counts) {
+    size_t n = inputLists.size();
+    std::vector<size_t> indices(begin_offsets);
 
-    // create a minheap to store the first element of all these lists
     MinHeap minHeap;
-    for (int i = 0; i < inputLists.size(); i++) {
-        if (!inputLists[i].empty()) {
-            minHeap.insert(inputLists[i][0], i);
-            indices[i] = 1;
+    for (int i = 0; i < n; i++) {
+        if (indices[i] < end_offsets[i]) {
+            minHeap.insert(inputLists[i][indices[i]], i);
+            indices[i]++;
         }
     }
 
-    unsigned long long int num_elements_processed = 0;
-    // while the heap is not empty
     while (!minHeap.isEmpty()) {
-        // pop the min element from the heap
         HashValueMembersOf* minElement = minHeap.pop();
-        
-        // insert 0 into the bit representation for all the lists
-        for (int i = 0; i < inputLists.size(); i++) {
-            bitRepresentation[i].push_back(0);
-        }
-        
-        // get the lists that contain this element using the member_of list
-        std::vector<unsigned long int> list_ids_where_this_element_a_member = minElement->members_of;
-        
-        // for each list that contain this element
-        for (auto list_id : list_ids_where_this_element_a_member) {
-            
-            // set the bit at the index to 1
-            bitRepresentation[list_id][num_elements_processed] = 1;
-            
-            // if the index is less than the size of the list, insert the element at that index into the heap
-            if (indices[list_id] < inputLists[list_id].size()) {
-                auto next_element = inputLists[list_id][indices[list_id]];
-                minHeap.insert(next_element, list_id);
+        const std::vector<unsigned long int>& members = minElement->members_of;
+
+        for (unsigned long int i = 0; i < members.size(); i++) {
+            unsigned long int list_id1 = members[i];
+            if (shared_counts) {
+                counts.incrementConcurrently(list_id1, list_id1);
+                for (unsigned long int j = i + 1; j < members.size(); j++) {
+                    counts.incrementConcurrently(list_id1, members[j]);
+                }
+            } else {
+                counts.at(list_id1, list_id1)++;
+                for (unsigned long int j = i + 1; j < members.size(); j++) {
+                    counts.at(list_id1, members[j])++;
+                }
             }
 
-            // increment the index for that list
-            indices[list_id]++;
+            if (indices[list_id1] < end_offsets[list_id1]) {
+                minHeap.insert(inputLists[list_id1][indices[list_id1]], list_id1);
+                indices[list_id1]++;
+            }
         }
 
-        // increment the number of elements processed
-        num_elements_processed++;
-
-        // delete the min element
         delete minElement;
+    }
+}
+
+
+
+// extra memory the parallel merge may spend on one private triangle per hash range, beyond the result triangle
+const size_t PRIVATE_TRIANGLES_MEMORY_BUDGET = 4ULL << 30;
+
+
 
+// same result as computeIntersectionMatrix, but the hash space is split into num_threads ranges merged independently
+TriangularCountMatrix computeIntersectionMatrixParallel(const std::vector<std::vector<unsigned long long int>>& inputLists, int num_threads) {
+    size_t n = inputLists.size();
+
+    // range t covers [splitters[t-1], splitters[t]), with the first and last ranges open-ended
+    std::vector<unsigned long long int> splitters = sampleSplitters(inputLists, num_threads);
+    int num_ranges = splitters.size() + 1;
+
+    // offsets[t][i] is where range t starts in list i, found by binary search
+    std::vector<std::vector<size_t>> offsets(num_ranges + 1, std::vector<size_t>(n, 0));
+    for (int i = 0; i < n; i++) {
+        for (int t = 1; t < num_ranges; t++) {
+            offsets[t][i] = std::lower_bound(inputLists[i].begin(), inputLists[i].end(), splitters[t-1]) - inputLists[i].begin();
+        }
+        offsets[num_ranges][i] = inputLists[i].size();
     }
 
-    return bitRepresentation;
-    
-   
+    // when the extra triangles fit in the budget, every range counts into its own triangle with plain increments and
+    // the triangles are summed after; otherwise all ranges count into one triangle with atomic increments, so the
+    // memory does not grow with the thread count. the ranges hold different hashes, so the atomics only meet on the
+    // genome pairs that share hashes in several ranges
+    TriangularCountMatrix counts(n);
+    size_t triangle_bytes = counts.counts.size() * sizeof(uint32_t);
+    bool private_counts = (num_ranges - 1) * triangle_bytes <= PRIVATE_TRIANGLES_MEMORY_BUDGET;
+
+    std::vector<TriangularCountMatrix> range_counts;
+    if (private_counts) {
+        range_counts.assign(num_ranges - 1, TriangularCountMatrix(n));
+        std::cout << "Counting the pairs of " << num_ranges << " hash ranges into private triangles" << std::endl;
+    } else {
+        std::cout << "Counting the pairs of " << num_ranges << " hash ranges into one shared triangle" << std::endl;
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_ranges; t++) {
+        threads.push_back(std::thread([&, t]() {
+            if (!private_counts) {
+                mergeHashRange<true>(inputLists, offsets[t], offsets[t+1], counts);
+            } else {
+                mergeHashRange<false>(inputLists, offsets[t], offsets[t+1], (t == 0) ? counts : range_counts[t-1]);
+            }
+        }));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    // sum the private triangles into the first one, each thread over its own slice of the cells
+    if (private_counts && !range_counts.empty()) {
+        threads.clear();
+        size_t num_cells = counts.counts.size();
+        for (int t = 0; t < num_threads; t++) {
+            threads.push_back(std::thread([&, t]() {
+                size_t begin = num_cells * t / num_threads;
+                size_t end = num_cells * (t + 1) / num_threads;
+                for (const auto& other : range_counts) {
+                    for (size_t k = begin; k < end; k++) {
+                        counts.counts[k] += other.counts[k];
+                    }
+                }
+            }));
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    return counts;
 }
 
 
 
+
 string decompressGzip(const std::string& filename) {
     // Open file
     gzFile file = gzopen(filename.c_str(), "rb");
@@ -296,12 +432,13 @@ string decompressGzip(const std::string& filename) {
 
 
 
-std::vector<unsigned long long int> read_min_hashes(const std::string& json_filename) {
+std::pair<std::vector<unsigned long long int>, std::string> read_min_hashes(const std::string& json_filename) {
     // if filename contains gz
     if (json_filename.find(".gz") != std::string::npos) {
         auto jsonData = json::parse(decompressGzip(json_filename));
         std::vector<unsigned long long int> min_hashes = jsonData[0]["signatures"][0]["mins"];
-        return min_hashes;
+        std::string genome_name = jsonData[0].value("name", "");
+        return {min_hashes, genome_name};
     }
 
     // Open the JSON file
@@ -319,24 +456,27 @@ std::vector<unsigned long long int> read_min_hashes(const std::string& json_file
 
     // Access and print values
     std::vector<unsigned long long int> min_hashes = jsonData[0]["signatures"][0]["mins"];
+    std::string genome_name = jsonData[0].value("name", "");
 
     // Close the file
     inputFile.close();
 
-    return min_hashes;
+    return {min_hashes, genome_name};
 }
 
 
 
-std::vector<std::vector<unsigned long long int>> read_sketches(std::vector<std::string> sketch_names) {
+std::vector<std::vector<unsigned long long int>> read_sketches(std::vector<std::string> sketch_names, std::vector<std::string>& genome_names) {
     std::vector<std::vector<unsigned long long int>> sketches;
     for (int i = 0; i < sketch_names.size(); i++) {
         if (i % 1000 == 0) {
             std::cout << "Reading sketch " << i << std::endl;
         }
         std::string sketch_name = sketch_names[i];
-        std::vector<unsigned long long int> min_hashes = read_min_hashes(sketch_name);
-        sketches.push_back(min_hashes);
+        auto min_hashes_genome_name = read_min_hashes(sketch_name);
+        sketches.push_back(min_hashes_genome_name.first);
+        // unnamed signatures are labelled by their path
+        genome_names.push_back(min_hashes_genome_name.second.empty() ? sketch_name : min_hashes_genome_name.second);
     }
     std::cout << "Finished reading " << sketch_names.size() << " sketches" << std::endl;
     return sketches;
@@ -357,36 +497,17 @@ std::vector<std::string> get_sketch_names(const std::string& filelist) {
 
 
 
-std::vector<std::vector<double>> compute_jaccard(std::vector<std::vector<unsigned long long int>> &intersectionMatrix) {
-    std::vector<std::vector<double>> jaccardMatrix;
-    for (int i = 0; i < intersectionMatrix.size(); i++) {
-        jaccardMatrix.push_back(std::vector<double>(intersectionMatrix.size(), 0.0));
-    }
-
-    for (int i = 0; i < intersectionMatrix.size(); i++) {
-        for (int j = 0; j < intersectionMatrix.size(); j++) {
-            if (i == j) {
-                jaccardMatrix[i][j] = 1.0;
-                continue;
-            }
-            if ((intersectionMatrix[i][i] + intersectionMatrix[j][j] - intersectionMatrix[i][j]) == 0) {
-                jaccardMatrix[i][j] = 0.0;
-                continue;
-            } 
-            jaccardMatrix[i][j] = 1.0 * intersectionMatrix[i][j] / (intersectionMatrix[i][i] + intersectionMatrix[j][j] - intersectionMatrix[i][j]);
-        }
-    }
-
-    return jaccardMatrix;
-}
-
-
-
 int main(int argc, char* argv[]) {
     
-    // command line arguments: filelist outputfile
-    if (argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " filelist outputfile" << std::endl;
+    // command line arguments: filelist outputfile [num_threads] [bitmatrix_csc_file]
+    if (argc < 3 || argc > 5) {
+        std::cerr << "Usage: " << argv[0] << " filelist outputfile [num_threads] [bitmatrix_csc_file]" << std::endl;
+        return 1;
+    }
+
+    int num_threads = (argc >= 4) ? std::stoi(argv[3]) : 1;
+    if (num_threads < 1) {
+        std::cerr << "num_threads must be at least 1" << std::endl;
         return 1;
     }
 
@@ -396,46 +517,64 @@ int main(int argc, char* argv[]) {
     std::vector<std::string> sketch_names = get_sketch_names(argv[1]);
 
     // read the sketches
-    std::vector<std::vector<unsigned long long int>> sketches = read_sketches(sketch_names);
+    std::vector<std::string> genome_names;
+    std::vector<std::vector<unsigned long long int>> sketches = read_sketches(sketch_names, genome_names);
 
     auto end_read = std::chrono::high_resolution_clock::now();
     std::cout << "Time taken to read the sketches: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_read - start).count() << " milliseconds" << std::endl;
 
 
-    // create the intersection matrix
-    std::vector<std::vector<unsigned long long int>> intersectionMatrix = computeIntersectionMatrix(sketches);
+    // export the packed bit representation if asked for
+    if (argc == 5) {
+        PackedBitMatrix bitRepresentation = createBitRepresentation(sketches);
+        writeCSC(bitRepresentation, argv[4]);
+        std::cout << "Bit matrix: " << bitRepresentation.num_rows << " sketches x " << bitRepresentation.num_cols << " hashes written to " << argv[4] << std::endl;
+    }
 
-    // create the jaccard matrix
-    std::vector<std::vector<double>> jaccardMatrix = compute_jaccard(intersectionMatrix);
+    // create the intersection matrix
+    TriangularCountMatrix intersectionMatrix = (num_threads == 1)
+        ? computeIntersectionMatrix(sketches)
+        : computeIntersectionMatrixParallel(sketches, num_threads);
+    std::cout << "Space used by the intersection matrix: " << intersectionMatrix.counts.size() * sizeof(uint32_t) / (1024 * 1024) << " MB" << std::endl;
 
     // show first 10x10 elements of the jaccard matrix
     std::cout << "First 10x10 elements of the jaccard matrix: " << std::endl;
-    int smaller = std::min(10, (int)jaccardMatrix.size());
+    int smaller = std::min(10, (int)intersectionMatrix.size());
     for (int i = 0; i < smaller; i++) {
         for (int j = 0; j < smaller; j++) {
-            std::cout << jaccardMatrix[i][j] << " ";
+            std::cout << intersectionMatrix.jaccard(i, j) << " ";
         }
         std::cout << std::endl;
     }
 
-    // write the jaccard matrix to the output file
-    std::ofstream outputFile(argv[2]);
-    for (int i = 0; i < jaccardMatrix.size(); i++) {
-        for (int j = 0; j < jaccardMatrix[i].size(); j++) {
-            outputFile << jaccardMatrix[i][j] << " ";
+    // write the jaccard matrix to the output file, computing every value from the counts
+    std::string output_filename = argv[2];
+    if (endsWith(output_filename, ".npy") || endsWith(output_filename, ".npy.gz")) {
+        bool gzip_output = endsWith(output_filename, ".gz");
+        writeNpyMatrix(output_filename, intersectionMatrix.size(), [&](size_t i, float* row) {
+            for (size_t j = 0; j < intersectionMatrix.size(); j++) {
+                row[j] = intersectionMatrix.jaccard(i, j);
+            }
+        }, gzip_output);
+        writeLabels(gzip_output ? output_filename.substr(0, output_filename.size() - 3) : output_filename, genome_names);
+    } else {
+        TextWriter outputFile(output_filename);
+        for (int i = 0; i < intersectionMatrix.size(); i++) {
+            for (int j = 0; j < intersectionMatrix.size(); j++) {
+                outputFile << intersectionMatrix.jaccard(i, j) << ' ';
+            }
+            outputFile << '\n';
         }
-        outputFile << std::endl;
-    }
 
-    // close the output file
-    outputFile.close();
+        // close the output file
+        outputFile.close();
+    }
 
     // show the first 10x10 elements in the intersection matrix
     std::cout << "First 10x10 elements of the intersection matrix: " << std::endl;
-    smaller = std::min(10, (int)intersectionMatrix.size());
     for (int i = 0; i < smaller; i++) {
         for (int j = 0; j < smaller; j++) {
-            std::cout << intersectionMatrix[i][j] << " ";
+            std::cout << intersectionMatrix.get(i, j) << " ";
         }
         std::cout << std::endl;
     }
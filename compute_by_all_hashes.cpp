@@ -8,8 +8,13 @@
 #include <fstream>
 #include <thread>
 #include <mutex>
+#include <numeric>
+#include <memory>
 
 #include "json.hpp"
+#include "pair_records.hpp"
+#include "text_output.hpp"
+#include "thread_pool.hpp"
 
 #include <zlib.h>
 
@@ -24,11 +29,19 @@ typedef unsigned long long int hash_t;
 
 std::vector<std::string> sketch_names;
 std::vector<std::string> genome_names;
+std::vector<std::string> genome_md5s;
 vector<vector<hash_t>> sketches;
 int num_sketches;
 int num_threads = 1;
+// the workers of every parallel stage, started once
+Eigen::ThreadPool* thread_pool = nullptr;
 unordered_map<hash_t, vector<int>> hash_index;
-int ** intersectionMatrix;
+// the intersection counts of the queries of a pass with every sketch. with --overlap-passes there are two, and
+// the rows of pass p are written from one on output_pool while pass p+1 fills the other
+int ** intersectionMatrices[2];
+int num_matrices = 1;
+bool overlap_passes = false;
+Eigen::ThreadPool* output_pool = nullptr;
 float containment_threshold = 0.01;
 int count_empty_sketch = 0;
 mutex mutex_count_empty_sketch;
@@ -36,6 +49,44 @@ mutex mutex_count_empty_sketch;
 vector<string> written_file_names;
 mutex mutex_written_file_names;
 
+// output format of the similar pairs: text lines, or fixed-width records (see pair_records.hpp)
+bool binary_output = false;
+int text_precision = DEFAULT_TEXT_PRECISION;
+
+// sourmash multisearch columns, with names and md5s copied from the interned tables
+bool multisearch_output = false;
+StringTable genome_name_table;
+StringTable genome_md5_table;
+const char* MULTISEARCH_HEADER = "query_name,query_md5,match_name,match_md5,containment,max_containment,jaccard,intersect_hashes\n";
+const char* MULTISEARCH_WEIGHTED_HEADER = "query_name,query_md5,match_name,match_md5,containment,max_containment,jaccard,intersect_hashes,weighted_containment\n";
+
+// fused dereplication: similars[i] collects every j with a reported (i, j) pair, filled only by the
+// thread that owns query i, and the greedy selection of post_process runs on it after the last pass.
+// pair files are then only written if asked for
+bool dereplicate = false;
+bool write_pairs = true;
+string dereplicate_output_filename;
+vector<vector<int>> similars;
+
+// dereplication against a growing index of the representatives, with no all-vs-all passes
+bool dereplicate_incremental = false;
+
+// single merged output: every thread keeps its rows of the pass in pass_outputs[thread_id], and after the
+// pass they are appended to merged_writer in query order while the next pass computes
+bool merged_output = false;
+string merged_output_filename;
+vector<vector<char>> pass_outputs;
+BackgroundFileWriter* merged_writer = nullptr;
+
+// abundance-weighted containment: the sum of the query's abundances over the shared hashes, divided by the
+// sum over all its hashes (sourmash's f_weighted). the weights come from the query side, so the index stays
+// hash -> sketch ids and the weighted sums grow in the same walk as the plain counts. a sketch without
+// "abundances" weighs every hash 1. the sums fit 32 bits up to about 4e12 k-mers at scaled 1000
+bool weighted_output = false;
+vector<vector<uint32_t>> abundances;
+vector<unsigned long long> abundance_totals;
+unsigned int ** weightedIntersectionMatrices[2];
+
 
 
 void compute_index_from_sketches() {
@@ -64,13 +115,13 @@ void compute_index_from_sketches() {
 
     // write the hash index to file
     string filename = "hash_index.txt";
-    ofstream outfile(filename);
+    TextWriter outfile(filename);
     for (auto it = hash_index.begin(); it != hash_index.end(); it++) {
-        outfile << it->first << " ";
+        outfile << it->first << ' ';
         for (int i = 0; i < it->second.size(); i++) {
-            outfile << it->second[i] << " ";
+            outfile << it->second[i] << ' ';
         }
-        outfile << endl;
+        outfile << '\n';
     }
     outfile.close();
 
@@ -129,7 +180,9 @@ void show_stats_of_hash_index() {
 using MapType = unordered_map<hash_t, vector<int>>;
 
 
-void compute_intersection_matrix_by_sketches(int sketch_start_index, int sketch_end_index, int thread_id, string out_dir, int pass_id, int negative_offset) {
+void accumulate_intersections(int sketch_start_index, int sketch_end_index, int negative_offset, int matrix_id) {
+    int** intersectionMatrix = intersectionMatrices[matrix_id];
+    unsigned int** weightedIntersectionMatrix = weightedIntersectionMatrices[matrix_id];
     for (int i = sketch_start_index; i < sketch_end_index; i++) {
         for (int j = 0; j < sketches[i].size(); j++) {
             hash_t hash = sketches[i][j];
@@ -138,9 +191,21 @@ void compute_intersection_matrix_by_sketches(int sketch_start_index, int sketch_
                 for (int k = 0; k < sketch_indices.size(); k++) {
                     intersectionMatrix[i-negative_offset][sketch_indices[k]]++;
                 }
+                if (weighted_output) {
+                    unsigned int abundance = abundances[i].empty() ? 1 : abundances[i][j];
+                    for (int k = 0; k < sketch_indices.size(); k++) {
+                        weightedIntersectionMatrix[i-negative_offset][sketch_indices[k]] += abundance;
+                    }
+                }
             }
         }
     }
+}
+
+
+void write_similar_pairs(int sketch_start_index, int sketch_end_index, int thread_id, string out_dir, int pass_id, int negative_offset, int matrix_id) {
+    int** intersectionMatrix = intersectionMatrices[matrix_id];
+    unsigned int** weightedIntersectionMatrix = weightedIntersectionMatrices[matrix_id];
 
     // write the similarity values to file. filename: out_dir/passid_threadid.txt, where id is thread id in 3 digits
     string id_in_three_digits_str = to_string(thread_id);
@@ -150,11 +215,34 @@ void compute_intersection_matrix_by_sketches(int sketch_start_index, int sketch_
     string pass_id_str = to_string(pass_id);
     //if ( pass_id_str.size() == 1 )
     //    pass_id_str = "0" + pass_id_str;
-    string filename = out_dir + "/" + pass_id_str + "_" + id_in_three_digits_str + ".txt";
-    ofstream outfile(filename);
+    string filename = out_dir + "/" + pass_id_str + "_" + id_in_three_digits_str + (binary_output ? ".bin" : (multisearch_output ? ".csv" : ".txt"));
+    TextWriter* outfile = nullptr;
+    PairRecordWriter* record_writer = nullptr;
+    vector<char> records_in_memory;
+    if (!write_pairs) {
+        // only the adjacency is kept
+    } else if (merged_output) {
+        if (!binary_output) {
+            outfile = new TextWriter(text_precision);
+        }
+    } else if (binary_output) {
+        record_writer = new PairRecordWriter(filename, num_sketches, containment_threshold);
+    } else {
+        outfile = new TextWriter(filename, text_precision);
+        if (multisearch_output) {
+            *outfile << (weighted_output ? MULTISEARCH_WEIGHTED_HEADER : MULTISEARCH_HEADER);
+        }
+    }
 
     for (int i = sketch_start_index; i < sketch_end_index; i++) {
         for (int j = 0; j < num_sketches; j++) {
+            // multisearch reports every sketch against itself
+            if (i == j && write_pairs && multisearch_output && sketches[i].size() > 0) {
+                *outfile << genome_name_table[i] << ',' << genome_md5_table[i] << ',' << genome_name_table[i] << ',' << genome_md5_table[i] << ",1,1,1," << sketches[i].size();
+                *outfile << (weighted_output ? ",1\n" : "\n");
+                continue;
+            }
+
             // skip obvious cases
             if (i == j) {
                 continue;
@@ -184,11 +272,58 @@ void compute_intersection_matrix_by_sketches(int sketch_start_index, int sketch_
                 continue;
             }
 
-            outfile << i << "," << j << "," << jaccard << "," << containment_i_in_j << "," << containment_j_in_i << endl;
+            if (dereplicate) {
+                similars[i].push_back(j);
+            }
+
+            if (!write_pairs) {
+                continue;
+            }
+
+            if (binary_output) {
+                PairRecord record = {(uint32_t)i, (uint32_t)j, (uint32_t)intersectionMatrix[i-negative_offset][j], (float)jaccard, (float)containment_i_in_j, (float)containment_j_in_i};
+                if (merged_output) {
+                    records_in_memory.insert(records_in_memory.end(), (const char*)&record, (const char*)&record + sizeof(record));
+                } else {
+                    record_writer->add(record);
+                }
+                continue;
+            }
+
+            if (multisearch_output) {
+                double max_containment = max(containment_i_in_j, containment_j_in_i);
+                *outfile << genome_name_table[i] << ',' << genome_md5_table[i] << ',' << genome_name_table[j] << ',' << genome_md5_table[j] << ','
+                         << containment_i_in_j << ',' << max_containment << ',' << jaccard << ',' << intersectionMatrix[i-negative_offset][j];
+            } else {
+                *outfile << i << ',' << j << ',' << jaccard << ',' << containment_i_in_j << ',' << containment_j_in_i;
+            }
+
+            if (weighted_output) {
+                double weighted_containment_i_in_j = 1.0 * weightedIntersectionMatrix[i-negative_offset][j] / abundance_totals[i];
+                *outfile << ',' << weighted_containment_i_in_j;
+            }
+            *outfile << '\n';
         }
     }
 
-    outfile.close();
+    if (!write_pairs) {
+        return;
+    }
+
+    if (merged_output) {
+        // rows of each thread are sorted by (query, match), and threads own consecutive query ranges
+        pass_outputs[thread_id] = binary_output ? std::move(records_in_memory) : outfile->take();
+        delete outfile;
+        return;
+    }
+
+    if (binary_output) {
+        record_writer->close();
+        delete record_writer;
+    } else {
+        outfile->close();
+        delete outfile;
+    }
 
     // write the filename to the written_file_names
     mutex_written_file_names.lock();
@@ -220,13 +355,31 @@ string decompressGzip(const std::string& filename) {
 }
 
 
-pair<std::vector<hash_t>, string> read_min_hashes(const std::string& json_filename) {
+struct SignatureData {
+    vector<hash_t> min_hashes;
+    string name;
+    string md5;
+    vector<uint32_t> abundances;
+};
+
+
+// the abundances are only read for the weighted output, and only if the signature has them
+vector<uint32_t> read_abundances(const json& signature) {
+    if (!weighted_output || !signature.contains("abundances")) {
+        return {};
+    }
+    return signature["abundances"].get<vector<uint32_t>>();
+}
+
+
+SignatureData read_min_hashes(const std::string& json_filename) {
     // if filename contains gz
     if (json_filename.find(".gz") != std::string::npos) {
         auto jsonData = json::parse(decompressGzip(json_filename));
         std::vector<hash_t> min_hashes = jsonData[0]["signatures"][0]["mins"];
         std::string genome_name = jsonData[0]["name"];
-        return {min_hashes, genome_name};
+        std::string md5 = jsonData[0]["signatures"][0].value("md5sum", "");
+        return {min_hashes, genome_name, md5, read_abundances(jsonData[0]["signatures"][0])};
     }
 
     // Open the JSON file
@@ -245,24 +398,32 @@ pair<std::vector<hash_t>, string> read_min_hashes(const std::string& json_filena
     // Access and print values
     std::vector<hash_t> min_hashes = jsonData[0]["signatures"][0]["mins"];
     std::string genome_name = jsonData[0]["name"];
+    std::string md5 = jsonData[0]["signatures"][0].value("md5sum", "");
 
     // Close the file
     inputFile.close();
 
-    return {min_hashes, genome_name};
+    return {min_hashes, genome_name, md5, read_abundances(jsonData[0]["signatures"][0])};
 }
 
 
-void read_sketches_one_chunk(int start_index, int end_index) {
-    for (int i = start_index; i < end_index; i++) {
-        auto min_hashes_genome_name = read_min_hashes(sketch_names[i]);
-        sketches[i] = min_hashes_genome_name.first;
-        genome_names[i] = min_hashes_genome_name.second;
-        if (sketches[i].size() == 0) {
-            mutex_count_empty_sketch.lock();
-            count_empty_sketch++;
-            mutex_count_empty_sketch.unlock();
+void read_one_sketch(int i) {
+    auto signature = read_min_hashes(sketch_names[i]);
+    sketches[i] = std::move(signature.min_hashes);
+    genome_names[i] = signature.name;
+    genome_md5s[i] = signature.md5;
+    if (weighted_output) {
+        if (!signature.abundances.empty() && signature.abundances.size() != sketches[i].size()) {
+            std::cerr << "Number of abundances and hashes differ in " << sketch_names[i] << std::endl;
+            exit(1);
         }
+        abundances[i] = std::move(signature.abundances);
+        abundance_totals[i] = abundances[i].empty() ? sketches[i].size() : accumulate(abundances[i].begin(), abundances[i].end(), 0ULL);
+    }
+    if (sketches[i].size() == 0) {
+        mutex_count_empty_sketch.lock();
+        count_empty_sketch++;
+        mutex_count_empty_sketch.unlock();
     }
 }
 
@@ -271,21 +432,25 @@ void read_sketches() {
     for (int i = 0; i < num_sketches; i++) {
         sketches.push_back( vector<hash_t>() );
     }
-    // initialize genome_names vector using empty strings
+    // initialize genome_names and genome_md5s vectors using empty strings
     for (int i = 0; i < num_sketches; i++) {
         genome_names.push_back("");
+        genome_md5s.push_back("");
     }
-
-    int chunk_size = num_sketches / num_threads;
-    vector<thread> threads;
-    for (int i = 0; i < num_threads; i++) {
-        int start_index = i * chunk_size;
-        int end_index = (i == num_threads - 1) ? num_sketches : (i + 1) * chunk_size;
-        threads.push_back(thread(read_sketches_one_chunk, start_index, end_index));
+    if (weighted_output) {
+        abundances.assign(num_sketches, vector<uint32_t>());
+        abundance_totals.assign(num_sketches, 0);
     }
-    for (int i = 0; i < num_threads; i++) {
-        threads[i].join();
+
+    // one task per sketch, so a few large sketches do not hold up a whole chunk
+    run_tasks(*thread_pool, num_sketches, read_one_sketch);
+
+    // intern the names and md5s for the multisearch output
+    for (int i = 0; i < num_sketches; i++) {
+        genome_name_table.add(genome_names[i]);
+        genome_md5_table.add(genome_md5s[i]);
     }
+
     // show the number of empty sketches
     cout << "Number of empty sketches: " << count_empty_sketch << endl;
 
@@ -319,9 +484,12 @@ void show_space_usages(int num_passes) {
     cout << "-----------------" << endl;
     size_t total_space = 0;
     for (int i = 0; i < num_sketches; i++) {
-        total_space += sizeof(int) * num_sketches;
+        total_space += sizeof(int) * num_sketches * num_matrices;
     }
     std::cout << "Total space used by intersection matrix: " << total_space / (1024 * 1024 * num_passes) << " MB" << std::endl;
+    if (weighted_output) {
+        std::cout << "Total space used by weighted intersection matrix: " << total_space / (1024 * 1024 * num_passes) << " MB" << std::endl;
+    }
 
     total_space = 0;
     for (auto it = hash_index.begin(); it != hash_index.end(); it++) {
@@ -335,6 +503,14 @@ void show_space_usages(int num_passes) {
     }
     std::cout << "Total space used by sketches: " << total_space / (1024 * 1024) << " MB" << std::endl;
 
+    if (weighted_output) {
+        total_space = 0;
+        for (int i = 0; i < num_sketches; i++) {
+            total_space += sizeof(uint32_t) * abundances[i].size();
+        }
+        std::cout << "Total space used by abundances: " << total_space / (1024 * 1024) << " MB" << std::endl;
+    }
+
     total_space = 0;
     for (int i = 0; i < num_sketches; i++) {
         total_space += sketch_names[i].size();
@@ -344,36 +520,291 @@ void show_space_usages(int num_passes) {
 }
 
 
+// sidecar for post_process: sketch size, md5 and name of every sketch, tab separated, in file list order,
+// so the sketches do not have to be parsed again just to learn their sizes
+void write_sketch_info() {
+    string sketch_info = "sketch_info.tsv";
+    TextWriter outfile(sketch_info);
+    outfile << "num_hashes\tmd5\tname\n";
+    for (int i = 0; i < num_sketches; i++) {
+        string name = genome_names[i];
+        replace_if(name.begin(), name.end(), [](char c) { return c == '\t' || c == '\n' || c == '\r'; }, ' ');
+        outfile << sketches[i].size() << '\t' << genome_md5s[i] << '\t' << name << '\n';
+    }
+    outfile.close();
+}
+
+
 void write_all_genome_names() {
     string all_genome_names = "all_genome_names.txt";
-    ofstream outfile(all_genome_names);
+    TextWriter outfile(all_genome_names);
     for (int i = 0; i < num_sketches; i++) {
-        outfile << genome_names[i] << endl;
+        outfile << genome_names[i] << '\n';
     }
     outfile.close();
 }
 
 
+// (genome id, sketch size) from the smallest sketch to the largest, in the order post_process walks them
+vector<pair<int, int>> genomes_by_size() {
+    vector<pair<int, int>> genome_id_size_pairs;
+    for (int i = 0; i < num_sketches; i++) {
+        genome_id_size_pairs.push_back({i, (int)sketches[i].size()});
+    }
+    sort(genome_id_size_pairs.begin(), genome_id_size_pairs.end(), [](const pair<int, int>& a, const pair<int, int>& b) {
+        return a.second < b.second;
+    });
+    return genome_id_size_pairs;
+}
+
+
+// the greedy rule of post_process: walk the genomes from the smallest sketch to the largest, and keep a
+// genome unless one of its similars that is not excluded yet has a sketch at least as large
+vector<int> select_representatives() {
+    vector<pair<int, int>> genome_id_size_pairs = genomes_by_size();
+
+    vector<int> selected_genome_ids;
+    vector<bool> genome_id_to_exclude(num_sketches, false);
+    for (int i = 0; i < num_sketches; i++) {
+        int genome_id_this = genome_id_size_pairs[i].first;
+        int size_this = genome_id_size_pairs[i].second;
+        bool select_this = true;
+        for (int j = 0; j < similars[genome_id_this].size(); j++) {
+            int genome_id_other = similars[genome_id_this][j];
+            if (genome_id_to_exclude[genome_id_other]) {
+                continue;
+            }
+            int size_other = sketches[genome_id_other].size();
+            if (size_other >= size_this) {
+                select_this = false;
+                break;
+            }
+        }
+        if (select_this) {
+            selected_genome_ids.push_back(genome_id_this);
+        } else {
+            genome_id_to_exclude[genome_id_this] = true;
+        }
+    }
+    return selected_genome_ids;
+}
+
+
+// the genomes in index that contain sketch g at containment_threshold or more, like a reported (g, j) pair.
+// with first_only, stops at the first one found
+vector<int> containing_genomes(int g, const MapType& index, vector<int>& counts, vector<int>& touched, bool first_only) {
+    vector<int> found;
+    double size_g = sketches[g].size();
+    for (hash_t hash : sketches[g]) {
+        auto it = index.find(hash);
+        if (it == index.end()) {
+            continue;
+        }
+        for (int j : it->second) {
+            if (j == g) {
+                continue;
+            }
+            if (counts[j] == 0) {
+                touched.push_back(j);
+            }
+            counts[j]++;
+            if (first_only && counts[j] / size_g >= containment_threshold) {
+                found.push_back(j);
+                break;
+            }
+        }
+        if (!found.empty()) {
+            break;
+        }
+    }
+    for (int j : touched) {
+        if (!first_only && counts[j] / size_g >= containment_threshold) {
+            found.push_back(j);
+        }
+        counts[j] = 0;
+    }
+    touched.clear();
+    return found;
+}
+
+
+// same selection as select_representatives, without the all-vs-all. a genome is rejected by any similar with a
+// larger sketch, so the genomes are walked from the largest sketch down, one group of equal sizes at a time.
+// most genomes are rejected by querying an index of the representatives kept so far; only the ones that pass
+// are checked against the index of every larger genome, which also finds similars that were not kept.
+// inside a group, the rule of select_representatives is applied to the pairs between the group's genomes
+vector<int> dereplicate_incrementally() {
+    vector<pair<int, int>> genome_id_size_pairs = genomes_by_size();
+    MapType representative_index;
+    MapType larger_genome_index;
+    vector<int> counts(num_sketches, 0);
+    vector<int> touched;
+    vector<bool> selected(num_sketches, false);
+    long long num_full_queries = 0;
+
+    int group_end = num_sketches;
+    while (group_end > 0) {
+        int group_start = group_end - 1;
+        while (group_start > 0 && genome_id_size_pairs[group_start - 1].second == genome_id_size_pairs[group_end - 1].second) {
+            group_start--;
+        }
+
+        // rejected by a genome with a larger sketch
+        vector<bool> exclude(group_end - group_start, false);
+        for (int i = group_start; i < group_end; i++) {
+            int g = genome_id_size_pairs[i].first;
+            if (!containing_genomes(g, representative_index, counts, touched, true).empty()) {
+                exclude[i - group_start] = true;
+                continue;
+            }
+            num_full_queries++;
+            exclude[i - group_start] = !containing_genomes(g, larger_genome_index, counts, touched, true).empty();
+        }
+
+        // ties, walked in the order of select_representatives: a similar later in the group always rejects,
+        // an earlier one only if it was kept
+        if (group_end - group_start > 1) {
+            MapType group_index;
+            unordered_map<int, int> position_in_group;
+            for (int i = group_start; i < group_end; i++) {
+                int g = genome_id_size_pairs[i].first;
+                position_in_group[g] = i - group_start;
+                for (hash_t hash : sketches[g]) {
+                    group_index[hash].push_back(g);
+                }
+            }
+            for (int i = group_start; i < group_end; i++) {
+                if (exclude[i - group_start]) {
+                    continue;
+                }
+                for (int o : containing_genomes(genome_id_size_pairs[i].first, group_index, counts, touched, false)) {
+                    int other = position_in_group[o];
+                    if (other > i - group_start || !exclude[other]) {
+                        exclude[i - group_start] = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        for (int i = group_start; i < group_end; i++) {
+            int g = genome_id_size_pairs[i].first;
+            selected[g] = !exclude[i - group_start];
+            for (hash_t hash : sketches[g]) {
+                larger_genome_index[hash].push_back(g);
+                if (selected[g]) {
+                    representative_index[hash].push_back(g);
+                }
+            }
+        }
+        group_end = group_start;
+    }
+
+    cout << "Genomes checked against all larger genomes: " << num_full_queries << endl;
+
+    // report in the order of select_representatives
+    vector<int> selected_genome_ids;
+    for (int i = 0; i < num_sketches; i++) {
+        if (selected[genome_id_size_pairs[i].first]) {
+            selected_genome_ids.push_back(genome_id_size_pairs[i].first);
+        }
+    }
+    return selected_genome_ids;
+}
+
+
 void cleanup(int num_sketches_each_pass) {
     // free memory of intersection matrix
-    for (int i = 0; i < num_sketches_each_pass + 1; i++) {
-        delete[] intersectionMatrix[i];
+    for (int m = 0; m < num_matrices; m++) {
+        for (int i = 0; i < num_sketches_each_pass + 1; i++) {
+            delete[] intersectionMatrices[m][i];
+        }
+        delete[] intersectionMatrices[m];
+        if (weighted_output) {
+            for (int i = 0; i < num_sketches_each_pass + 1; i++) {
+                delete[] weightedIntersectionMatrices[m][i];
+            }
+            delete[] weightedIntersectionMatrices[m];
+        }
     }
-    delete[] intersectionMatrix;
 }
 
 
 int main(int argc, char* argv[]) {
     
-    // command line arguments: filelist outputfile
-    if (argc != 8) {
-        std::cerr << "Usage: " << argv[0] << " <file_list> <out_dir> <num_threads> <num_passes> <containment_threshold> <test_mode> <load_hash_index>" << std::endl;
+    // command line arguments: filelist outputfile, then options
+    if (argc < 8) {
+        std::cerr << "Usage: " << argv[0] << " <file_list> <out_dir> <num_threads> <num_passes> <containment_threshold> <test_mode> <load_hash_index> [options]" << std::endl;
+        std::cerr << "Options:" << std::endl;
+        std::cerr << "  --format text|binary|multisearch" << std::endl;
+        std::cerr << "                          write similar pairs as text lines (default), binary pair records, or" << std::endl;
+        std::cerr << "                          sourmash multisearch CSV with names and md5s (self matches included)" << std::endl;
+        std::cerr << "  --precision N           significant digits of the similarity values in text output (default " << DEFAULT_TEXT_PRECISION << ")" << std::endl;
+        std::cerr << "  --merged-output FILE    write all pairs to FILE, sorted by (query, match), instead of one file per pass and thread;" << std::endl;
+        std::cerr << "                          gzip-compressed if FILE ends in .gz" << std::endl;
+        std::cerr << "  --dereplicate FILE      select representatives like post_process in this run and write their sketch" << std::endl;
+        std::cerr << "                          paths to FILE; similar pairs are kept in memory and not written to disk" << std::endl;
+        std::cerr << "  --keep-pairs            with --dereplicate, also write the similar pairs" << std::endl;
+        std::cerr << "  --weighted              add the abundance-weighted containment of the query in the match as a last column" << std::endl;
+        std::cerr << "                          (text and multisearch formats); sketches without abundances weigh every hash 1" << std::endl;
+        std::cerr << "  --dereplicate-incremental FILE" << std::endl;
+        std::cerr << "                          same selection as --dereplicate, by querying each genome against the representatives" << std::endl;
+        std::cerr << "                          kept so far instead of computing all pairs; no pairs or hash index are written" << std::endl;
+        std::cerr << "  --overlap-passes        write the pairs of each pass on separate threads while the next pass is computed;" << std::endl;
+        std::cerr << "                          keeps two intersection matrices, so twice the memory per pass" << std::endl;
+        return 1;
+    }
+
+    bool keep_pairs = false;
+    for (int i = 8; i < argc; i++) {
+        string option = argv[i];
+        if (option == "--format" && i + 1 < argc) {
+            string format = argv[++i];
+            if (format != "text" && format != "binary" && format != "multisearch") {
+                std::cerr << "Unknown output format: " << format << std::endl;
+                return 1;
+            }
+            binary_output = (format == "binary");
+            multisearch_output = (format == "multisearch");
+        } else if (option == "--precision" && i + 1 < argc) {
+            text_precision = std::stoi(argv[++i]);
+        } else if (option == "--dereplicate" && i + 1 < argc) {
+            dereplicate = true;
+            dereplicate_output_filename = argv[++i];
+        } else if (option == "--dereplicate-incremental" && i + 1 < argc) {
+            dereplicate_incremental = true;
+            dereplicate_output_filename = argv[++i];
+        } else if (option == "--weighted") {
+            weighted_output = true;
+        } else if (option == "--overlap-passes") {
+            overlap_passes = true;
+        } else if (option == "--keep-pairs") {
+            keep_pairs = true;
+        } else if (option == "--merged-output" && i + 1 < argc) {
+            merged_output = true;
+            merged_output_filename = argv[++i];
+        } else {
+            std::cerr << "Unknown option: " << option << std::endl;
+            return 1;
+        }
+    }
+
+    write_pairs = !dereplicate || keep_pairs;
+
+    if (weighted_output && binary_output) {
+        std::cerr << "--weighted is not available with --format binary" << std::endl;
         return 1;
     }
 
     auto start_program = std::chrono::high_resolution_clock::now();
 
     num_threads = std::stoi(argv[3]);
+    Eigen::ThreadPool pool(num_threads);
+    thread_pool = &pool;
+    // the output stage gets workers of its own, so writing never waits behind the tasks of the next pass
+    unique_ptr<Eigen::ThreadPool> writing_pool(overlap_passes ? new Eigen::ThreadPool(num_threads) : nullptr);
+    output_pool = overlap_passes ? writing_pool.get() : &pool;
+    num_matrices = overlap_passes ? 2 : 1;
     int num_passes = std::stoi(argv[4]);
     containment_threshold = std::stof(argv[5]);
     bool test_mode = std::stoi(argv[6]);
@@ -389,6 +820,20 @@ int main(int argc, char* argv[]) {
     auto end_read = std::chrono::high_resolution_clock::now();
     std::cout << "Time taken to read the sketches: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_read - start_program).count() << " milliseconds" << std::endl;
 
+    if (dereplicate_incremental) {
+        vector<int> selected_genome_ids = dereplicate_incrementally();
+        TextWriter outfile(dereplicate_output_filename);
+        for (int i = 0; i < selected_genome_ids.size(); i++) {
+            outfile << sketch_names[selected_genome_ids[i]] << '\n';
+        }
+        outfile.close();
+        auto end_select = std::chrono::high_resolution_clock::now();
+        std::cout << "Selected " << selected_genome_ids.size() << " of " << num_sketches << " genomes in " << std::chrono::duration_cast<std::chrono::milliseconds>(end_select - end_read).count() << " milliseconds" << std::endl;
+        write_all_genome_names();
+        write_sketch_info();
+        return 0;
+    }
+
     // create the index if needed. otherwise, load from file
     auto start = std::chrono::high_resolution_clock::now();
     if (load_hash_index_flag) {
@@ -409,9 +854,17 @@ int main(int argc, char* argv[]) {
 
     // allocate memory for the intersection matrix
     int num_sketches_each_pass = ceil(1.0 * num_sketches / num_passes);
-    intersectionMatrix = new int*[num_sketches_each_pass + 1];
-    for (int i = 0; i < num_sketches_each_pass + 1; i++) {
-        intersectionMatrix[i] = new int[num_sketches];
+    for (int m = 0; m < num_matrices; m++) {
+        intersectionMatrices[m] = new int*[num_sketches_each_pass + 1];
+        for (int i = 0; i < num_sketches_each_pass + 1; i++) {
+            intersectionMatrices[m][i] = new int[num_sketches];
+        }
+        if (weighted_output) {
+            weightedIntersectionMatrices[m] = new unsigned int*[num_sketches_each_pass + 1];
+            for (int i = 0; i < num_sketches_each_pass + 1; i++) {
+                weightedIntersectionMatrices[m][i] = new unsigned int[num_sketches];
+            }
+        }
     }
 
     // in test mode, exit now
@@ -423,44 +876,119 @@ int main(int argc, char* argv[]) {
     
     written_file_names = vector<string>();
 
-    for (int pass_id = 0; pass_id < num_passes; pass_id++) {
-        // set zeros in the intersection matrix
-        for (int i = 0; i < num_sketches_each_pass+1; i++) {
-            for (int j = 0; j < num_sketches; j++) {
-                intersectionMatrix[i][j] = 0;
+    if (dereplicate) {
+        similars.assign(num_sketches, vector<int>());
+    }
+
+    if (merged_output && write_pairs) {
+        // room for a whole pass of buffers, so the next pass does not wait for the previous one to be written
+        bool gzip_output = merged_output_filename.size() > 3 && merged_output_filename.substr(merged_output_filename.size() - 3) == ".gz";
+        merged_writer = new BackgroundFileWriter(merged_output_filename, gzip_output, num_threads + 1);
+        if (binary_output) {
+            PairRecordHeader header = make_pair_record_header(num_sketches, containment_threshold);
+            merged_writer->write(vector<char>((const char*)&header, (const char*)&header + sizeof(header)));
+        } else if (multisearch_output) {
+            const char* header = weighted_output ? MULTISEARCH_WEIGHTED_HEADER : MULTISEARCH_HEADER;
+            merged_writer->write(vector<char>(header, header + strlen(header)));
+        }
+        written_file_names.push_back(merged_output_filename);
+    }
+
+    // the output stage in flight: the write tasks of one pass, which own pass_outputs and similars until waited for.
+    // at most one pass is written at a time, so the next pass computes ahead by at most one pass
+    unique_ptr<TaskGroup> writing;
+    int writing_pass_id = -1;
+    auto finish_writing = [&]() {
+        if (!writing) {
+            return;
+        }
+        writing->wait();
+        writing.reset();
+
+        // the thread outputs cover consecutive query ranges, so the k-way merge by (query, match) is
+        // appending them in thread order; the writer thread compresses and writes them during the next pass
+        if (merged_output && write_pairs) {
+            for (int i = 0; i < num_threads; i++) {
+                if (!pass_outputs[i].empty()) {
+                    merged_writer->write(std::move(pass_outputs[i]));
+                }
             }
         }
 
+        // show progress
+        std::cout << "Pass " << writing_pass_id << "/" << num_passes << " done." << std::endl;
+    };
+
+    for (int pass_id = 0; pass_id < num_passes; pass_id++) {
+        // the matrix of this pass was last written two passes ago, and that output stage is done
+        int matrix_id = pass_id % num_matrices;
+        int** intersectionMatrix = intersectionMatrices[matrix_id];
+        unsigned int** weightedIntersectionMatrix = weightedIntersectionMatrices[matrix_id];
+
+        // set zeros in the intersection matrix, rows in parallel
+        parallel_for(*thread_pool, num_sketches_each_pass + 1, [&](long long i) {
+            fill(intersectionMatrix[i], intersectionMatrix[i] + num_sketches, 0);
+            if (weighted_output) {
+                fill(weightedIntersectionMatrix[i], weightedIntersectionMatrix[i] + num_sketches, 0);
+            }
+        });
+
         // indices
         int sketch_idx_start_this_pass = pass_id * num_sketches_each_pass;
         int sketch_idx_end_this_pass = (pass_id == num_passes - 1) ? num_sketches : (pass_id + 1) * num_sketches_each_pass;
         int negative_offset = pass_id * num_sketches_each_pass;
         int num_sketches_this_pass = sketch_idx_end_this_pass - sketch_idx_start_this_pass;
-        
-        // create threads
-        vector<thread> threads;
+
+        // one task per query range on the pool; a range keeps its number in the output file names
         int chunk_size = num_sketches_this_pass / num_threads;
-        for (int i = 0; i < num_threads; i++) {
-            int start_index_this_thread = sketch_idx_start_this_pass + i * chunk_size;
-            int end_index_this_thread = (i == num_threads - 1) ? sketch_idx_end_this_pass : sketch_idx_start_this_pass + (i + 1) * chunk_size;
-            threads.push_back( thread(compute_intersection_matrix_by_sketches, start_index_this_thread, end_index_this_thread, i, argv[2], pass_id, negative_offset) );
+        auto range_start = [=](int i) { return sketch_idx_start_this_pass + i * chunk_size; };
+        auto range_end = [=](int i) { return (i == num_threads - 1) ? sketch_idx_end_this_pass : sketch_idx_start_this_pass + (i + 1) * chunk_size; };
+        run_tasks(*thread_pool, num_threads, [&](int i) {
+            accumulate_intersections(range_start(i), range_end(i), negative_offset, matrix_id);
+        });
+
+        // hand this pass to the output stage once the previous one is written
+        finish_writing();
+        if (merged_output && write_pairs) {
+            pass_outputs.assign(num_threads, vector<char>());
         }
-
-        // join threads
+        writing.reset(new TaskGroup(*output_pool));
+        writing_pass_id = pass_id;
+        string out_dir = argv[2];
         for (int i = 0; i < num_threads; i++) {
-            threads[i].join();
+            writing->run([=]() {
+                write_similar_pairs(range_start(i), range_end(i), i, out_dir, pass_id, negative_offset, matrix_id);
+            });
+        }
+        if (!overlap_passes) {
+            finish_writing();
         }
+    }
+    finish_writing();
 
-        // show progress
-        std::cout << "Pass " << pass_id << "/" << num_passes << " done." << std::endl;
+    if (merged_output && write_pairs) {
+        merged_writer->close();
+        delete merged_writer;
     }
 
+    // select the representatives from the in-memory adjacency
+    if (dereplicate) {
+        auto start_select = std::chrono::high_resolution_clock::now();
+        vector<int> selected_genome_ids = select_representatives();
+        TextWriter outfile(dereplicate_output_filename);
+        for (int i = 0; i < selected_genome_ids.size(); i++) {
+            outfile << sketch_names[selected_genome_ids[i]] << '\n';
+        }
+        outfile.close();
+        auto end_select = std::chrono::high_resolution_clock::now();
+        std::cout << "Selected " << selected_genome_ids.size() << " of " << num_sketches << " genomes in " << std::chrono::duration_cast<std::chrono::milliseconds>(end_select - start_select).count() << " milliseconds" << std::endl;
+    }
 
     // write all the written file names to a file
     string written_file_names_filename = "by_index_file_names.txt";
-    ofstream written_filelist_file(written_file_names_filename);
+    TextWriter written_filelist_file(written_file_names_filename);
     for (int i = 0; i < written_file_names.size(); i++) {
-        written_filelist_file << written_file_names[i] << endl;
+        written_filelist_file << written_file_names[i] << '\n';
     }
     written_filelist_file.close();
     
@@ -477,8 +1005,9 @@ int main(int argc, char* argv[]) {
     // show space usages
     show_space_usages(num_passes);
 
-    // write all genome names
+    // write all genome names, and the sizes for post_process
     write_all_genome_names();
+    write_sketch_info();
     
     return 0;
 
@@ -6,8 +6,13 @@
 #include <algorithm>
 #include <unordered_set>
 #include <fstream>
+#include <cstdint>
+#include <functional>
 
+#include "bit_matrix.hpp"
 #include "json.hpp"
+#include "npy_matrix.hpp"
+#include "text_output.hpp"
 
 #include <cuda_runtime.h>
 #include <cublas_v2.h>
@@ -118,73 +123,7 @@ public:
 
 
 
-std::vector<std::vector<bool>> createBitRepresentation(const std::vector<std::vector<unsigned long long int>>& inputLists) {
-    // create return list
-    std::vector<std::vector<bool>> bitRepresentation;
-    for (int i = 0; i < inputLists.size(); i++) {
-        bitRepresentation.push_back(std::vector<bool>());
-    }
-
-    // create an array of indices to keep track of the current element of each list
-    std::vector<int> indices(inputLists.size(), 0);
-
-    // create a minheap to store the first element of all these lists
-    MinHeap minHeap;
-    for (int i = 0; i < inputLists.size(); i++) {
-        if (!inputLists[i].empty()) {
-            minHeap.insert(inputLists[i][0], i);
-            indices[i] = 1;
-        }
-    }
-
-    unsigned long long int num_elements_processed = 0;
-    // while the heap is not empty
-    while (!minHeap.isEmpty()) {
-        // pop the min element from the heap
-        HashValueMembersOf* minElement = minHeap.pop();
-        
-        // insert 0 into the bit representation for all the lists
-        for (int i = 0; i < inputLists.size(); i++) {
-            bitRepresentation[i].push_back(0);
-        }
-        
-        // get the lists that contain this element using the member_of list
-        std::vector<unsigned long int> list_ids_where_this_element_a_member = minElement->members_of;
-        
-        // for each list that contain this element
-        for (auto list_id : list_ids_where_this_element_a_member) {
-            
-            // set the bit at the index to 1
-            bitRepresentation[list_id][num_elements_processed] = 1;
-            
-            // if the index is less than the size of the list, insert the element at that index into the heap
-            if (indices[list_id] < inputLists[list_id].size()) {
-                auto next_element = inputLists[list_id][indices[list_id]];
-                minHeap.insert(next_element, list_id);
-            }
-
-            // increment the index for that list
-            indices[list_id]++;
-        }
-
-        // increment the number of elements processed
-        num_elements_processed++;
-
-        // delete the min element
-        delete minElement;
-
-    }
-
-    return bitRepresentation;
-    
-   
-}
-
-
-
-
-
-std::vector<unsigned long long int> read_min_hashes(const std::string& json_filename) {
+std::pair<std::vector<unsigned long long int>, std::string> read_min_hashes(const std::string& json_filename) {
     // Open the JSON file
     std::ifstream inputFile(json_filename);
 
@@ -200,20 +139,23 @@ std::vector<unsigned long long int> read_min_hashes(const std::string& json_file
 
     // Access and print values
     std::vector<unsigned long long int> min_hashes = jsonData[0]["signatures"][0]["mins"];
+    std::string genome_name = jsonData[0].value("name", "");
 
     // Close the file
     inputFile.close();
 
-    return min_hashes;
+    return {min_hashes, genome_name};
 }
 
 
 
-std::vector<std::vector<unsigned long long int>> read_sketches(std::vector<std::string> sketch_names) {
+std::vector<std::vector<unsigned long long int>> read_sketches(std::vector<std::string> sketch_names, std::vector<std::string>& genome_names) {
     std::vector<std::vector<unsigned long long int>> sketches;
     for (const auto& sketch_name : sketch_names) {
-        std::vector<unsigned long long int> min_hashes = read_min_hashes(sketch_name);
-        sketches.push_back(min_hashes);
+        auto min_hashes_genome_name = read_min_hashes(sketch_name);
+        sketches.push_back(min_hashes_genome_name.first);
+        // unnamed signatures are labelled by their path
+        genome_names.push_back(min_hashes_genome_name.second.empty() ? sketch_name : min_hashes_genome_name.second);
     }
     return sketches;
 }
@@ -233,36 +175,11 @@ std::vector<std::string> get_sketch_names(const std::string& filelist) {
 
 
 
-std::vector<std::vector<double>> compute_jaccard(std::vector<std::vector<unsigned long long int>> &intersectionMatrix) {
-    std::vector<std::vector<double>> jaccardMatrix;
-    for (int i = 0; i < intersectionMatrix.size(); i++) {
-        jaccardMatrix.push_back(std::vector<double>(intersectionMatrix.size(), 0.0));
-    }
-
-    for (int i = 0; i < intersectionMatrix.size(); i++) {
-        for (int j = 0; j < intersectionMatrix.size(); j++) {
-            if (i == j) {
-                jaccardMatrix[i][j] = 1.0;
-                continue;
-            }
-            if ((intersectionMatrix[i][i] + intersectionMatrix[j][j] - intersectionMatrix[i][j]) == 0) {
-                jaccardMatrix[i][j] = 0.0;
-                continue;
-            } 
-            jaccardMatrix[i][j] = 1.0 * intersectionMatrix[i][j] / (intersectionMatrix[i][i] + intersectionMatrix[j][j] - intersectionMatrix[i][j]);
-        }
-    }
-
-    return jaccardMatrix;
-}
-
-
-
 int main(int argc, char* argv[]) {
     
-    // command line arguments: filelist outputfile
-    if (argc != 4) {
-        std::cerr << "Usage: " << argv[0] << " filelist outputfile gpu_id" << std::endl;
+    // command line arguments: filelist outputfile gpu_id [bitmatrix_csc_file]
+    if (argc != 4 && argc != 5) {
+        std::cerr << "Usage: " << argv[0] << " filelist outputfile gpu_id [bitmatrix_csc_file]" << std::endl;
         return 1;
     }
 
@@ -272,20 +189,32 @@ int main(int argc, char* argv[]) {
     std::vector<std::string> sketch_names = get_sketch_names(argv[1]);
 
     // read the sketches
-    std::vector<std::vector<unsigned long long int>> sketches = read_sketches(sketch_names);
+    std::vector<std::string> genome_names;
+    std::vector<std::vector<unsigned long long int>> sketches = read_sketches(sketch_names, genome_names);
 
     // compute the bit representation
-    std::vector<std::vector<bool>> bitRepresentation = createBitRepresentation(sketches);
+    PackedBitMatrix bitRepresentation = createBitRepresentation(sketches);
+
+    // export the bit matrix if asked for
+    if (argc == 5) {
+        writeCSC(bitRepresentation, argv[4]);
+    }
 
     // represent the bit representation as a float matrix
-    size_t num_rows = bitRepresentation.size();
-    size_t num_cols = bitRepresentation[0].size();
-
-    float *h_A = new float[num_rows * num_cols];
-    // store the bit representation in the matrix in column-major order
-    for (int i = 0; i < num_rows; i++) {
-        for (int j = 0; j < num_cols; j++) {
-            h_A[j * num_rows + i] = bitRepresentation[i][j];
+    size_t num_rows = bitRepresentation.num_rows;
+    size_t num_cols = bitRepresentation.num_cols;
+
+    // store the bit representation in the matrix in column-major order, touching only the set bits
+    float *h_A = new float[num_rows * num_cols]();
+    for (size_t b = 0; b < bitRepresentation.num_blocks; b++) {
+        for (size_t i = 0; i < num_rows; i++) {
+            const uint64_t *row_words = bitRepresentation.rowBlock(i, b);
+            for (size_t w = 0; w < PackedBitMatrix::WORDS_PER_BLOCK; w++) {
+                for (uint64_t bits = row_words[w]; bits; bits &= bits - 1) {
+                    size_t j = b * PackedBitMatrix::BLOCK_COLUMNS + w * 64 + __builtin_ctzll(bits);
+                    h_A[j * num_rows + i] = 1.0f;
+                }
+            }
         }
     }
 
@@ -324,52 +253,62 @@ int main(int argc, char* argv[]) {
     // destroy the handle
     CHECK_CUBLAS(cublasDestroy(handle));
 
-    // the result h_C is in column-major order, convert it to a 2D float matrix
-    std::vector<std::vector<unsigned long long int>> intersectionMatrix;
-    for (int i = 0; i < num_rows; i++) {
-        intersectionMatrix.push_back(std::vector<unsigned long long int>(num_rows, 0));
-    }
-
-    for (int i = 0; i < num_rows; i++) {
-        for (int j = 0; j < num_rows; j++) {
-            intersectionMatrix[i][j] = h_C[j * num_rows + i];
-        }
-    }
-
-    // delete the host memory
     delete[] h_A;
-    delete[] h_C;
 
-    // compute the jaccard similarity
-    std::vector<std::vector<double>> jaccardMatrix = compute_jaccard(intersectionMatrix);
+    // h_C holds the symmetric intersection counts; the jaccard of each pair is computed from it while writing
+    auto jaccard = [&](size_t i, size_t j) -> double {
+        if (i == j) {
+            return 1.0;
+        }
+        double intersection = h_C[j * num_rows + i];
+        double union_size = h_C[i * num_rows + i] + h_C[j * num_rows + j] - intersection;
+        if (union_size == 0) {
+            return 0.0;
+        }
+        return intersection / union_size;
+    };
 
     // write the jaccard matrix to a file
-    std::ofstream outputFile(argv[2]);
-    for (int i = 0; i < jaccardMatrix.size(); i++) {
-        for (int j = 0; j < jaccardMatrix.size(); j++) {
-            outputFile << jaccardMatrix[i][j] << " ";
+    std::string output_filename = argv[2];
+    if (endsWith(output_filename, ".npy") || endsWith(output_filename, ".npy.gz")) {
+        bool gzip_output = endsWith(output_filename, ".gz");
+        writeNpyMatrix(output_filename, num_rows, [&](size_t i, float* row) {
+            for (size_t j = 0; j < num_rows; j++) {
+                row[j] = jaccard(i, j);
+            }
+        }, gzip_output);
+        writeLabels(gzip_output ? output_filename.substr(0, output_filename.size() - 3) : output_filename, genome_names);
+    } else {
+        TextWriter outputFile(output_filename);
+        for (size_t i = 0; i < num_rows; i++) {
+            for (size_t j = 0; j < num_rows; j++) {
+                outputFile << jaccard(i, j) << ' ';
+            }
+            outputFile << '\n';
         }
-        outputFile << std::endl;
+        outputFile.close();
     }
-    outputFile.close();
 
     // show the first 10x10 elements of the jaccard matrix
-    for (int i = 0; i < 10; i++) {
-        for (int j = 0; j < 10; j++) {
-            std::cout << jaccardMatrix[i][j] << " ";
+    size_t smaller = std::min((size_t)10, num_rows);
+    for (size_t i = 0; i < smaller; i++) {
+        for (size_t j = 0; j < smaller; j++) {
+            std::cout << jaccard(i, j) << " ";
         }
         std::cout << std::endl;
     }
 
 
     // show the result, first 10x10
-    for (int i = 0; i < 10; i++) {
-        for (int j = 0; j < 10; j++) {
-            std::cout << intersectionMatrix[i][j] << " ";
+    for (size_t i = 0; i < smaller; i++) {
+        for (size_t j = 0; j < smaller; j++) {
+            std::cout << (unsigned long long int)h_C[j * num_rows + i] << " ";
         }
         std::cout << std::endl;
     }
 
+    delete[] h_C;
+
     auto end = std::chrono::high_resolution_clock::now();
     std::cout << "Time taken: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count() << " milliseconds" << std::endl; 
 
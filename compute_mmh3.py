@@ -1,7 +1,40 @@
 import mmh3
 
-s = "ACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAGACGTGCAG"
-k = 21
+# writes mmh3_golden.hpp, which mmh3_benchmark checks the C++ kernels against: python compute_mmh3.py > mmh3_golden.hpp
+# the sequence is random, so no two k-mers are the same, and the k-mer sizes are those with a specialised kernel:
+# 21 and 51 leave a tail of 5 and 3 bytes after the 16-byte blocks, 31 a tail of 15 that also goes through k2
 
-for i in range(len(s) - k + 1):
-    print(mmh3.hash64(s[i:i+k], signed=False))
\ No newline at end of file
+s = "TCGCTGCTGTCGGACTCCTAGTTACGTGGCGTTGCTCCACAGGTAGCCTGCCGTCGTGGTCCGCAACACTCGCACGCTGTTTCAGGGCGATCCTCCGGATAACACCACCTCCACAAACGAAGACAACCCTCTGGTTCTTTCCCGTCCGTA"
+ksizes = [21, 31, 51]
+
+print("#ifndef MMH3_GOLDEN_HPP")
+print("#define MMH3_GOLDEN_HPP")
+print()
+print("#include <cstdint>")
+print()
+print("// the output of compute_mmh3.py (Python mmh3.hash64, unsigned, seed 0) for every k-mer of its sequence, for each")
+print("// k-mer size: the reference the C++ and CUDA MurmurHash3 kernels must reproduce bit for bit")
+print()
+print('const char MMH3_GOLDEN_SEQUENCE[] = "%s";' % s)
+print("const uint32_t MMH3_GOLDEN_SEED = 0;")
+for k in ksizes:
+    print()
+    print("const uint64_t MMH3_GOLDEN_HASHES_%d[%d][2] = {" % (k, len(s) - k + 1))
+    for i in range(len(s) - k + 1):
+        h1, h2 = mmh3.hash64(s[i:i+k], signed=False)
+        print("    {%dULL, %dULL}," % (h1, h2))
+    print("};")
+print()
+print("struct Mmh3GoldenVector {")
+print("    int k;")
+print("    int count;")
+print("    const uint64_t (*hashes)[2];")
+print("};")
+print()
+print("const int MMH3_GOLDEN_NUM_VECTORS = %d;" % len(ksizes))
+print("const Mmh3GoldenVector MMH3_GOLDEN_VECTORS[MMH3_GOLDEN_NUM_VECTORS] = {")
+for k in ksizes:
+    print("    {%d, %d, MMH3_GOLDEN_HASHES_%d}," % (k, len(s) - k + 1, k))
+print("};")
+print()
+print("#endif")
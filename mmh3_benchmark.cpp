@@ -0,0 +1,344 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mmh3_golden.hpp"
+#include "murmur_hash3.hpp"
+#include "sequence_reader.hpp"
+
+using namespace std;
+
+// throughput and conformance of the MurmurHash3 kernels on every k-mer of a sequence. each variant writes both
+// halves of every hash, is timed over a number of repeats (the best one counts) and must match the runtime-length
+// scalar hash bit for bit; the scalar hash itself is first checked against the golden output of compute_mmh3.py
+
+struct Variant
+{
+    std::string name;
+    int threads;
+    // hashes the k-mers starting at [start, end) of the sequence into out[2 * start ..)
+    void (*hash)(const char *sequence, size_t start, size_t end, int k, uint32_t seed, uint64_t *out);
+};
+
+void hash_scalar(const char *sequence, size_t start, size_t end, int k, uint32_t seed, uint64_t *out)
+{
+    for (size_t i = start; i < end; i++)
+    {
+        MurmurHash3_x64_128(sequence + i, k, seed, out + 2 * i);
+    }
+}
+
+template <int K>
+void hash_fixed(const char *sequence, size_t start, size_t end, int, uint32_t seed, uint64_t *out)
+{
+    for (size_t i = start; i < end; i++)
+    {
+        MurmurHash3_x64_128_fixed<K>(sequence + i, seed, out + 2 * i);
+    }
+}
+
+// L::LANES consecutive k-mers per call, the rest one by one
+template <int K, typename L>
+void hash_lanes(const char *sequence, size_t start, size_t end, int, uint32_t seed, uint64_t *out)
+{
+    const int lanes = L::LANES;
+    size_t i = start;
+    for (; i + lanes <= end; i += lanes)
+    {
+        const char *keys[lanes];
+        uint64_t h1[lanes], h2[lanes];
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            keys[lane] = sequence + i + lane;
+        }
+        MurmurHash3_x64_128_lanes<K, L>(keys, seed, h1, h2);
+        for (int lane = 0; lane < lanes; lane++)
+        {
+            out[2 * (i + lane)] = h1[lane];
+            out[2 * (i + lane) + 1] = h2[lane];
+        }
+    }
+    for (; i < end; i++)
+    {
+        MurmurHash3_x64_128_fixed<K>(sequence + i, seed, out + 2 * i);
+    }
+}
+
+// the kernels specialised for a k-mer size; other sizes only have the runtime-length hash
+template <int K>
+void add_fixed_variants(std::vector<Variant> &variants, int num_threads)
+{
+    variants.push_back({"fixed-k scalar", 1, hash_fixed<K>});
+    variants.push_back({"lanes x1 scalar", 1, hash_lanes<K, MurmurLanesScalar>});
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+    variants.push_back({"lanes x8 avx512", 1, hash_lanes<K, MurmurLanesAVX512>});
+#endif
+    if (num_threads > 1)
+    {
+        variants.push_back({"lanes x" + std::to_string(MurmurLanes::LANES) + ", " + std::to_string(num_threads) + " threads", num_threads, hash_lanes<K, MurmurLanes>});
+    }
+}
+
+std::vector<Variant> variants_for(int k, int num_threads)
+{
+    std::vector<Variant> variants;
+    variants.push_back({"runtime-k scalar", 1, hash_scalar});
+    switch (k)
+    {
+    case 21: add_fixed_variants<21>(variants, num_threads); break;
+    case 31: add_fixed_variants<31>(variants, num_threads); break;
+    case 51: add_fixed_variants<51>(variants, num_threads); break;
+    default:
+        if (num_threads > 1)
+        {
+            variants.push_back({"runtime-k scalar, " + std::to_string(num_threads) + " threads", num_threads, hash_scalar});
+        }
+    }
+    return variants;
+}
+
+// the k-mers are split into one consecutive range per thread
+void run_variant(const Variant &variant, const std::string &sequence, int k, uint32_t seed, uint64_t *out)
+{
+    size_t num_kmers = sequence.size() - k + 1;
+    if (variant.threads == 1)
+    {
+        variant.hash(sequence.data(), 0, num_kmers, k, seed, out);
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < variant.threads; t++)
+    {
+        size_t start = num_kmers * t / variant.threads;
+        size_t end = num_kmers * (t + 1) / variant.threads;
+        threads.push_back(std::thread(variant.hash, sequence.data(), start, end, k, seed, out));
+    }
+    for (auto &th : threads)
+    {
+        th.join();
+    }
+}
+
+// every variant on every k-mer of the golden sequence, for each k-mer size of the golden file; returns the number of
+// hashes checked, or -1 on a mismatch
+int check_golden(int num_threads)
+{
+    std::string sequence = MMH3_GOLDEN_SEQUENCE;
+    int num_checked = 0;
+    bool ok = true;
+    for (const auto &golden : MMH3_GOLDEN_VECTORS)
+    {
+        for (const auto &variant : variants_for(golden.k, num_threads))
+        {
+            std::vector<uint64_t> out(2 * golden.count);
+            run_variant(variant, sequence, golden.k, MMH3_GOLDEN_SEED, out.data());
+            for (int i = 0; i < golden.count; i++)
+            {
+                if (out[2 * i] != golden.hashes[i][0] || out[2 * i + 1] != golden.hashes[i][1])
+                {
+                    std::cerr << "golden mismatch: " << variant.name << ", k=" << golden.k << ", k-mer " << i << ": " << out[2 * i] << " " << out[2 * i + 1]
+                              << " instead of " << golden.hashes[i][0] << " " << golden.hashes[i][1] << std::endl;
+                    ok = false;
+                    break;
+                }
+            }
+            num_checked += golden.count;
+        }
+    }
+    return ok ? num_checked : -1;
+}
+
+// a file of "kmer h1 h2" lines, as mmh3_using_cpu writes them, checked against the scalar hash
+bool check_hash_file(const std::string &filename, uint32_t seed)
+{
+    std::ifstream file(filename);
+    if (!file.is_open())
+    {
+        std::cerr << "Could not open the file: " << filename << std::endl;
+        return false;
+    }
+    std::string kmer;
+    uint64_t h1, h2;
+    long long num_lines = 0;
+    while (file >> kmer >> h1 >> h2)
+    {
+        uint64_t expected[2];
+        MurmurHash3_x64_128(kmer.data(), kmer.size(), seed, expected);
+        if (h1 != expected[0] || h2 != expected[1])
+        {
+            std::cerr << filename << ", line " << num_lines + 1 << ": " << kmer << " " << h1 << " " << h2
+                      << " instead of " << expected[0] << " " << expected[1] << std::endl;
+            return false;
+        }
+        num_lines++;
+    }
+    std::cout << filename << ": " << num_lines << " hashes agree" << std::endl;
+    return true;
+}
+
+// up to max_length bases of the records of a FASTA/FASTQ file, joined
+std::string read_genome(const std::string &filename, size_t max_length)
+{
+    SequenceReader reader(filename);
+    std::string sequence, name;
+    std::vector<char> buffer(SequenceReader::CHUNK_SIZE);
+    while (sequence.size() < max_length && reader.next_record(name))
+    {
+        size_t n;
+        while (sequence.size() < max_length && (n = reader.read_bases(buffer.data(), std::min(buffer.size(), max_length - sequence.size()))) > 0)
+        {
+            sequence.append(buffer.data(), n);
+        }
+    }
+    return sequence;
+}
+
+std::string random_sequence(size_t length)
+{
+    std::mt19937_64 rng(1);
+    std::string sequence(length, 'A');
+    for (size_t i = 0; i < length; i++)
+    {
+        sequence[i] = "ACGT"[rng() & 3];
+    }
+    return sequence;
+}
+
+std::vector<int> parse_list(const std::string &text)
+{
+    std::vector<int> values;
+    std::stringstream ss(text);
+    std::string value;
+    while (std::getline(ss, value, ','))
+    {
+        values.push_back(std::stoi(value));
+    }
+    return values;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t length = 1 << 24;
+    std::vector<int> ksizes = {21, 31, 51};
+    int num_threads = std::thread::hardware_concurrency();
+    int repeats = 3;
+    uint32_t seed = 42;
+    std::vector<std::string> genome_files;
+    std::vector<std::string> hash_files;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string option = argv[i];
+        if (option == "--length" && i + 1 < argc)
+        {
+            length = std::stoull(argv[++i]);
+        }
+        else if (option == "--ksize" && i + 1 < argc)
+        {
+            ksizes = parse_list(argv[++i]);
+        }
+        else if (option == "--threads" && i + 1 < argc)
+        {
+            num_threads = std::stoi(argv[++i]);
+        }
+        else if (option == "--repeats" && i + 1 < argc)
+        {
+            repeats = std::stoi(argv[++i]);
+        }
+        else if (option == "--seed" && i + 1 < argc)
+        {
+            seed = std::stoul(argv[++i]);
+        }
+        else if (option == "--check" && i + 1 < argc)
+        {
+            hash_files.push_back(argv[++i]);
+        }
+        else if (option.rfind("--", 0) == 0)
+        {
+            std::cerr << "Usage: " << argv[0] << " [options] [genome files]" << std::endl;
+            std::cerr << "  hashes every k-mer of a random sequence, and of each FASTA/FASTQ file given, with every kernel variant" << std::endl;
+            std::cerr << "  --length N         bases of the random sequence, and at most as many of each genome (default 16777216)" << std::endl;
+            std::cerr << "  --ksize K[,K...]   k-mer sizes (default 21,31,51)" << std::endl;
+            std::cerr << "  --threads T        threads of the threaded variant (default: all cores)" << std::endl;
+            std::cerr << "  --repeats R        runs of each variant, the fastest is reported (default 3)" << std::endl;
+            std::cerr << "  --seed N           hash seed (default 42)" << std::endl;
+            std::cerr << "  --check FILE       check a \"kmer h1 h2\" file written with seed 0 (mmh3_using_cpu) against the scalar hash" << std::endl;
+            return 1;
+        }
+        else
+        {
+            genome_files.push_back(option);
+        }
+    }
+
+    // conformance first: a kernel that disagrees is not worth timing
+    int num_golden = check_golden(num_threads);
+    if (num_golden < 0)
+    {
+        return 1;
+    }
+    std::cout << "golden vectors of compute_mmh3.py (k=21,31,51): " << num_golden << " hashes of all variants agree" << std::endl;
+    for (const auto &filename : hash_files)
+    {
+        if (!check_hash_file(filename, 0))
+        {
+            return 1;
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> inputs = {{"random", random_sequence(length)}};
+    for (const auto &filename : genome_files)
+    {
+        inputs.push_back({filename, read_genome(filename, length)});
+    }
+
+    bool ok = true;
+    printf("%-12s %4s  %-28s %10s %10s %12s\n", "input", "k", "variant", "GB/s", "Mkmer/s", "Mkmer/s/core");
+    for (const auto &input : inputs)
+    {
+        const std::string &sequence = input.second;
+        for (int k : ksizes)
+        {
+            if (k < 8 || sequence.size() < (size_t)k)
+            {
+                continue;
+            }
+            size_t num_kmers = sequence.size() - k + 1;
+            std::vector<uint64_t> reference(2 * num_kmers);
+            std::vector<uint64_t> out(2 * num_kmers);
+            hash_scalar(sequence.data(), 0, num_kmers, k, seed, reference.data());
+
+            for (const auto &variant : variants_for(k, num_threads))
+            {
+                double best = 0;
+                for (int r = 0; r < repeats; r++)
+                {
+                    std::fill(out.begin(), out.end(), 0);
+                    auto start = std::chrono::steady_clock::now();
+                    run_variant(variant, sequence, k, seed, out.data());
+                    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                    best = (r == 0 || seconds < best) ? seconds : best;
+                }
+                bool agrees = memcmp(out.data(), reference.data(), out.size() * sizeof(uint64_t)) == 0;
+                ok = ok && agrees;
+                // GB/s of sequence: one new base per k-mer
+                double kmers_per_second = num_kmers / best;
+                printf("%-12s %4d  %-28s %10.3f %10.1f %12.1f%s\n", input.first.substr(0, 12).c_str(), k, variant.name.c_str(),
+                       kmers_per_second / 1e9, kmers_per_second / 1e6, kmers_per_second / 1e6 / variant.threads, agrees ? "" : "  MISMATCH");
+            }
+        }
+    }
+
+    if (!ok)
+    {
+        std::cerr << "some variants do not agree with the scalar hash" << std::endl;
+        return 1;
+    }
+    return 0;
+}
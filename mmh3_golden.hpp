@@ -0,0 +1,384 @@
+#ifndef MMH3_GOLDEN_HPP
+#define MMH3_GOLDEN_HPP
+
+#include <cstdint>
+
+// the output of compute_mmh3.py (Python mmh3.hash64, unsigned, seed 0) for every k-mer of its sequence, for each
+// k-mer size: the reference the C++ and CUDA MurmurHash3 kernels must reproduce bit for bit
+
+const char MMH3_GOLDEN_SEQUENCE[] = "TCGCTGCTGTCGGACTCCTAGTTACGTGGCGTTGCTCCACAGGTAGCCTGCCGTCGTGGTCCGCAACACTCGCACGCTGTTTCAGGGCGATCCTCCGGATAACACCACCTCCACAAACGAAGACAACCCTCTGGTTCTTTCCCGTCCGTA";
+const uint32_t MMH3_GOLDEN_SEED = 0;
+
+const uint64_t MMH3_GOLDEN_HASHES_21[130][2] = {
+    {15789796333190324015ULL, 8651784395729526237ULL},
+    {7673975639709951773ULL, 14072208670236985811ULL},
+    {13563325036206855206ULL, 2470033488749110849ULL},
+    {14069553500603561034ULL, 7910822008406172064ULL},
+    {7871541766003797111ULL, 4190712688648501799ULL},
+    {1092444261832490209ULL, 6503778258037892832ULL},
+    {11045459142483928785ULL, 9972430812063185270ULL},
+    {2644563755496004463ULL, 8373963729084525716ULL},
+    {8111533077140586862ULL, 3189261322727610857ULL},
+    {1182337086409401122ULL, 3065516838240500768ULL},
+    {4318534756176518241ULL, 12219015920301837901ULL},
+    {13920671819723716402ULL, 17576732863875160606ULL},
+    {5302197175236408044ULL, 9370224758703873869ULL},
+    {9189053796128103088ULL, 3967831553788613783ULL},
+    {6256102639181651028ULL, 1036308353387471854ULL},
+    {490424084466709979ULL, 17525377811576598632ULL},
+    {1555663412065551676ULL, 9104108359400610334ULL},
+    {10259247869136271802ULL, 1963457051997608910ULL},
+    {12701282627845106219ULL, 6037024001472847048ULL},
+    {3608900140049919840ULL, 14742586443471634763ULL},
+    {5745203233099039723ULL, 5332059042673501755ULL},
+    {8846927367696428172ULL, 15636373468711542795ULL},
+    {15461694814115501424ULL, 10146586982254138446ULL},
+    {1641627611876793111ULL, 9972193819027868721ULL},
+    {16022585982850470994ULL, 779983144217538380ULL},
+    {17411595498348344735ULL, 16497649486493310375ULL},
+    {10641870608998424398ULL, 8125667991678179295ULL},
+    {6064596230046654905ULL, 12745812566406532231ULL},
+    {9939670114491803503ULL, 11539411807770603292ULL},
+    {13598887059479316230ULL, 4529591708587099444ULL},
+    {5231379952101992674ULL, 14604110959526770047ULL},
+    {3151673459604372357ULL, 12554964457071049805ULL},
+    {15380696428707457593ULL, 11613282779782394429ULL},
+    {18390773611747654188ULL, 8430710946210409236ULL},
+    {16811302783603508378ULL, 11544041099643245596ULL},
+    {8860377536521431685ULL, 8779202378975418907ULL},
+    {17231633854716395295ULL, 15121617731729818873ULL},
+    {3175354869102057055ULL, 8998270109630958703ULL},
+    {9038544992889809350ULL, 1271399555214771709ULL},
+    {18074623820535735856ULL, 13369384334006497684ULL},
+    {17567286558126362918ULL, 8753255600438914361ULL},
+    {8130623911419167030ULL, 2324469656301794625ULL},
+    {13336676208358047986ULL, 13519150232833797254ULL},
+    {18376182766757425272ULL, 14343388918146692273ULL},
+    {555953430423904092ULL, 13193550511672388395ULL},
+    {16011418970826087778ULL, 7309999008680760551ULL},
+    {3648630073797134558ULL, 6741940975567331731ULL},
+    {10339029772184964622ULL, 6071877667170010435ULL},
+    {18235359166746713794ULL, 12746060401288789621ULL},
+    {14679679040300296621ULL, 14330661607025499255ULL},
+    {133851701209536555ULL, 5311209862912616329ULL},
+    {14043235733361267637ULL, 11195803285977734093ULL},
+    {98210939518513951ULL, 1461456226967465369ULL},
+    {15903568116293575103ULL, 17409637841103183921ULL},
+    {15208874428160062362ULL, 16067277668467470383ULL},
+    {13526220443702309112ULL, 17926626634089422791ULL},
+    {12576692415293714555ULL, 17031073707324115464ULL},
+    {7231521114949068591ULL, 12169783315906982807ULL},
+    {15959500815885529619ULL, 12592486650322782232ULL},
+    {13711829240655299563ULL, 13190061628495534929ULL},
+    {6656835296261001702ULL, 8450722152701975506ULL},
+    {14015613940715206219ULL, 14827310536911549710ULL},
+    {13501911869045385093ULL, 1483232843962986974ULL},
+    {9329787386007823455ULL, 7062956494302672768ULL},
+    {5396660449584383093ULL, 4228149122838347227ULL},
+    {7645158049279579608ULL, 8049905352828052717ULL},
+    {1645143919032190192ULL, 4741100942406541524ULL},
+    {9436310485768792934ULL, 8724946461419131138ULL},
+    {10040924489758073203ULL, 13761483819078782786ULL},
+    {13791884526738438021ULL, 4110092819842261885ULL},
+    {6088101505691541068ULL, 12588963832485935831ULL},
+    {1401730283346590214ULL, 2854135732592708650ULL},
+    {13264701900414423925ULL, 10933887687548990822ULL},
+    {12228426754342751735ULL, 4444330468452733681ULL},
+    {2479058895566518253ULL, 1387296511467022005ULL},
+    {5323294877966069860ULL, 15261728818554780439ULL},
+    {5790411746811124925ULL, 3871921333652512640ULL},
+    {3138282521826872773ULL, 3127680501644357775ULL},
+    {12976190372895986981ULL, 7729173509542768916ULL},
+    {4731493144610509035ULL, 6111721016805312965ULL},
+    {2880343513031033827ULL, 9409337569049509296ULL},
+    {14269537186039430195ULL, 4121403276638513416ULL},
+    {12173846987250911134ULL, 4510976539165003332ULL},
+    {8295873784717623418ULL, 15661935944080799732ULL},
+    {17055680689787391997ULL, 15458504112509804198ULL},
+    {9497604651845003095ULL, 8960260781950187929ULL},
+    {12384590444497514157ULL, 18106174472507716594ULL},
+    {3649287653613149603ULL, 14508471814067345282ULL},
+    {186377257185299136ULL, 18440018945949558740ULL},
+    {4431944885931134987ULL, 14327370198740439880ULL},
+    {10961075222169972931ULL, 14569548569021269328ULL},
+    {12299377389233669129ULL, 5888633140851145266ULL},
+    {7845107619700773745ULL, 2440669150839408ULL},
+    {12526980610638544073ULL, 16524427374817287155ULL},
+    {12265433598287316025ULL, 12293971540107942222ULL},
+    {5959472867365305510ULL, 5838701374658048634ULL},
+    {13688620561693459581ULL, 11840357146571025450ULL},
+    {5756865814574769284ULL, 9017604244345454604ULL},
+    {1293905841502256516ULL, 10090364614966915495ULL},
+    {15871639538105973524ULL, 2988041953609193348ULL},
+    {13613255694901830759ULL, 13458646399259991495ULL},
+    {3805212531407968335ULL, 1104785989410006814ULL},
+    {17716168106590667182ULL, 15447253636729060472ULL},
+    {6553661395387943638ULL, 18141959037342462408ULL},
+    {8250696659644291900ULL, 1839513693141712974ULL},
+    {10774937486062189149ULL, 7429554384838944753ULL},
+    {11203660392020976633ULL, 11945092968344129131ULL},
+    {15203503549941373773ULL, 11427795846018947323ULL},
+    {13366050952916462899ULL, 14025420881043600963ULL},
+    {3666251297069249618ULL, 11420440204448975642ULL},
+    {9912064752345256822ULL, 4658515879209998254ULL},
+    {16898928538064931870ULL, 7879304797342059203ULL},
+    {13572955952240737792ULL, 15679308859378477858ULL},
+    {8316481636986491668ULL, 10659712698266713513ULL},
+    {2890748525997534370ULL, 360466299981433510ULL},
+    {2014970274534624906ULL, 4660765331470080093ULL},
+    {4689025909387692321ULL, 15301956896597624234ULL},
+    {11021938786812460143ULL, 5561147796479874511ULL},
+    {4413321360991893385ULL, 1830923061324533445ULL},
+    {10880930001787822199ULL, 16527220629884294857ULL},
+    {9530903902898336116ULL, 16705257979161426322ULL},
+    {13340228275734129074ULL, 4045604582725208203ULL},
+    {129102076702607503ULL, 3591074716505803688ULL},
+    {13023017955523486144ULL, 12517843573550292195ULL},
+    {2545740939217663131ULL, 5263730662452812866ULL},
+    {3305312919399401545ULL, 2028124419646623789ULL},
+    {17798032271495199070ULL, 2719520451098713742ULL},
+    {3437458620929044241ULL, 3879787631694711204ULL},
+    {9045740471451225918ULL, 15301748216574427912ULL},
+    {14332501395895709415ULL, 5003835509474197855ULL},
+};
+
+const uint64_t MMH3_GOLDEN_HASHES_31[120][2] = {
+    {15086060256745450859ULL, 11904623260468341991ULL},
+    {9673564125833493443ULL, 15038325696969489500ULL},
+    {6078264014490642837ULL, 4795545677109216245ULL},
+    {6882653509867508252ULL, 3199644469530257131ULL},
+    {4747442181715065396ULL, 9644816539822370654ULL},
+    {11212557249657553947ULL, 3815364460689049197ULL},
+    {11652813546530712045ULL, 13196968151260885944ULL},
+    {6389437546374075432ULL, 7982453936287427321ULL},
+    {17973298477094622855ULL, 14458313904188705752ULL},
+    {5259267819841069424ULL, 2381611565083558559ULL},
+    {14797663534952677553ULL, 15913158104966009098ULL},
+    {2423995428428687428ULL, 17076782227961101093ULL},
+    {5208825362871730059ULL, 9656885152398466892ULL},
+    {17502702327243810476ULL, 6691529069490286936ULL},
+    {12844313911298995141ULL, 3343437540372479778ULL},
+    {137689692046647958ULL, 16520744679867111926ULL},
+    {11313772460989812085ULL, 11028275309024515360ULL},
+    {17272548788918966114ULL, 10269556626182055109ULL},
+    {6361345327965740977ULL, 17414653329069139427ULL},
+    {7691936415101314236ULL, 15727158134713961829ULL},
+    {11124486301105777837ULL, 16253991259930867915ULL},
+    {13107092584668949277ULL, 1064319849678915412ULL},
+    {15970328956308427966ULL, 1951376831911052872ULL},
+    {7582858664264436530ULL, 17607456614421108449ULL},
+    {5469007067714889709ULL, 11899533952216770289ULL},
+    {10939116100194241589ULL, 6482698361699450833ULL},
+    {6382915275787761868ULL, 8631270253783369129ULL},
+    {804361243127618851ULL, 3443353564942905095ULL},
+    {17733528368723910523ULL, 4355171625298992927ULL},
+    {15353330538387697721ULL, 4144960097590267215ULL},
+    {1169023236085174153ULL, 10996750817479534335ULL},
+    {9029230723981406754ULL, 8301072947726023790ULL},
+    {2013376020641815436ULL, 15536415945604027721ULL},
+    {109505248106769410ULL, 12224599403944528825ULL},
+    {5434279895042603065ULL, 8036995584275505364ULL},
+    {7556661912279709047ULL, 7467192510211804099ULL},
+    {17556867631934336489ULL, 18104762813929575870ULL},
+    {443238602060906496ULL, 14741538535532761188ULL},
+    {15123297200028653339ULL, 7650432295883247961ULL},
+    {9621185107886564190ULL, 12193753758654282603ULL},
+    {5611444465907004112ULL, 10303452349654011537ULL},
+    {12168122390030746788ULL, 2131691276098961719ULL},
+    {5954349683470884841ULL, 9601488407780708257ULL},
+    {14460297451469268687ULL, 12497119430942261200ULL},
+    {9595351131596343126ULL, 1349355513058875300ULL},
+    {5193915887894449867ULL, 14241850167492989688ULL},
+    {16168639081430411870ULL, 12722920222600283035ULL},
+    {9209338873825586847ULL, 16248540331009332531ULL},
+    {6199913577061878684ULL, 14336770706301339804ULL},
+    {16359657973677821761ULL, 16984679775686512301ULL},
+    {9709736382047955604ULL, 4654326385499130115ULL},
+    {1799849573189168242ULL, 18355377623689554652ULL},
+    {10530476223361926938ULL, 3268014287085214659ULL},
+    {16645110847902487938ULL, 8185108119080408957ULL},
+    {7825093769391329081ULL, 342875032292616366ULL},
+    {10957340034776103035ULL, 4305168431314481433ULL},
+    {16513856827389353274ULL, 16590770716345225601ULL},
+    {15405943060756232458ULL, 13955119732022475841ULL},
+    {3944705002552318595ULL, 9438096735066938365ULL},
+    {3894878992268064222ULL, 10038343842281422998ULL},
+    {5514538889484352221ULL, 2906266155583950378ULL},
+    {11374324555151146379ULL, 9396924579553239631ULL},
+    {15736223985281833741ULL, 12474387779069588876ULL},
+    {424374267787616058ULL, 2057369803968677963ULL},
+    {3069232726360149859ULL, 4798309536580434557ULL},
+    {6920028969417715367ULL, 7959113552607524692ULL},
+    {1402463076562994099ULL, 4538006989402739718ULL},
+    {7107460716226807908ULL, 12502917625657463271ULL},
+    {7704826115555674639ULL, 11795454642110300356ULL},
+    {13417444782397040163ULL, 2408105881031492586ULL},
+    {14275325723227117576ULL, 8422322329331258290ULL},
+    {8279486284494610770ULL, 8417987500809169114ULL},
+    {5086857655847424830ULL, 12785624057373924279ULL},
+    {7263160815162135560ULL, 603537207700633687ULL},
+    {463653154291767203ULL, 11902030104912230899ULL},
+    {15694936607939716066ULL, 1872769092983294016ULL},
+    {4083550509495380872ULL, 2456898241531448892ULL},
+    {951129500902325945ULL, 9602237426111717946ULL},
+    {17371231612958849467ULL, 10452644478296432074ULL},
+    {15834175740071524361ULL, 7948838350119047835ULL},
+    {6288306389166580059ULL, 16320991117177990789ULL},
+    {10862575023647023862ULL, 13581919285944759047ULL},
+    {16427986468931450700ULL, 1194968351198956470ULL},
+    {818764508920239726ULL, 12736199452972826997ULL},
+    {4439423680452748241ULL, 3212085915465283433ULL},
+    {1181458328836489701ULL, 6929967532213794343ULL},
+    {8539745969254701182ULL, 13303290895947638317ULL},
+    {17473763993720626212ULL, 5835413515063903314ULL},
+    {9828021344777557116ULL, 14073413104049795834ULL},
+    {11397420888639514992ULL, 6341549719985875691ULL},
+    {14197013509718383350ULL, 6048204928132189978ULL},
+    {14362459916941551685ULL, 8416023810872337955ULL},
+    {15339739023487514535ULL, 16762273643692992861ULL},
+    {4464254310006931455ULL, 9247250183570468082ULL},
+    {7781025260813179064ULL, 13438878748560255815ULL},
+    {15977976966018733762ULL, 12054262154783076432ULL},
+    {741047699279087251ULL, 17548563091374451144ULL},
+    {16615884633143795959ULL, 12013262249650388361ULL},
+    {9789439833034440303ULL, 14532792013671116844ULL},
+    {958027635405562309ULL, 4339349162187105842ULL},
+    {7542773010331288084ULL, 1884926971416971796ULL},
+    {10762708323536424955ULL, 17109111709749018299ULL},
+    {14246417999663685740ULL, 15850855477161308516ULL},
+    {3749852612012785717ULL, 16437675475314497772ULL},
+    {4651322351059394280ULL, 8849964521769935758ULL},
+    {13068319480006009821ULL, 646433509654764086ULL},
+    {1886201295368450839ULL, 5606548731991326402ULL},
+    {601455741120450768ULL, 5525292990053078616ULL},
+    {14792291783240776703ULL, 13836053946395460231ULL},
+    {13162027431244248815ULL, 3452141547439508833ULL},
+    {9869956815413958327ULL, 10820841095868654056ULL},
+    {7959121415388373710ULL, 16030802606728010437ULL},
+    {10232459049156431377ULL, 13001102219953777004ULL},
+    {6476528950024389476ULL, 17440881559899069077ULL},
+    {11837558801935115122ULL, 10142179089481157177ULL},
+    {13757714881534051554ULL, 11479634310136684456ULL},
+    {11880046059344925781ULL, 10684932522794703279ULL},
+    {15869424238214581298ULL, 2328746747164201193ULL},
+    {5575354020021686815ULL, 13327782746299308037ULL},
+    {18426791722093413004ULL, 7576028685757230639ULL},
+};
+
+const uint64_t MMH3_GOLDEN_HASHES_51[100][2] = {
+    {765964516662929313ULL, 6004940259655968535ULL},
+    {4554913516298946942ULL, 8925217312487226145ULL},
+    {1732991966603432377ULL, 7341409186273257685ULL},
+    {676940666371459284ULL, 3637943952057379097ULL},
+    {14995235518138661999ULL, 14139819554599874615ULL},
+    {17925752240980586926ULL, 888973334649130688ULL},
+    {16546290596282398879ULL, 13958511830529756159ULL},
+    {1259941768809970727ULL, 18104628329210903884ULL},
+    {1527402359066900840ULL, 14044635791734566159ULL},
+    {8617478040976771549ULL, 6752903028201505869ULL},
+    {12335034650548920071ULL, 6410533021425380998ULL},
+    {9363065244846164499ULL, 5845906426215291071ULL},
+    {16107547039124617267ULL, 380858641720118414ULL},
+    {1919352467604955583ULL, 2795448775341034341ULL},
+    {7063854350409291021ULL, 4096371893781933705ULL},
+    {3381379503048162426ULL, 13166887210827820685ULL},
+    {16210557006588542050ULL, 9277965950566391499ULL},
+    {16865746465599520346ULL, 783542943829296387ULL},
+    {10429600460716282588ULL, 7064022443498685784ULL},
+    {6966682762355132527ULL, 5202327960636678418ULL},
+    {15803791443726700305ULL, 2254271624970054628ULL},
+    {18092735425945485632ULL, 14494267989528203284ULL},
+    {1993483537713228300ULL, 10563826193712109925ULL},
+    {9238562069283245316ULL, 11750357970059553097ULL},
+    {8248328854549181303ULL, 10296701909177321798ULL},
+    {14554537940212191923ULL, 7190597218463365797ULL},
+    {3059630683083113393ULL, 14370579589408394497ULL},
+    {16019471621525386243ULL, 374382552114525799ULL},
+    {9900105725428853589ULL, 7073840719708360597ULL},
+    {13984063999755771391ULL, 18438542550703216806ULL},
+    {13120780164307005440ULL, 13468710716061091023ULL},
+    {16443497623276274388ULL, 15997657772390847262ULL},
+    {17803952724788859288ULL, 11245577298272894918ULL},
+    {5822686348067230694ULL, 15259808944194671909ULL},
+    {16625516411896162848ULL, 12516323223113408756ULL},
+    {16047844207482164233ULL, 17740568372928369076ULL},
+    {10408162509572142898ULL, 11983697607699688026ULL},
+    {16032669016500531104ULL, 17984753575053565829ULL},
+    {16816208686218329907ULL, 5661669219541958004ULL},
+    {17628901028767138872ULL, 9163517296429103280ULL},
+    {550566438362564127ULL, 10576849166275896135ULL},
+    {17056563642124376543ULL, 4521051618057444719ULL},
+    {5556994102767541212ULL, 3589482171357127718ULL},
+    {1614531100755704173ULL, 6718293896612335263ULL},
+    {7747919053178836392ULL, 9429377083038760384ULL},
+    {4054185827200774217ULL, 8887292384545652004ULL},
+    {2019534992728941801ULL, 12594338437850041539ULL},
+    {6383933442829583508ULL, 5340598541499997147ULL},
+    {6509045810431227121ULL, 10125600281866089454ULL},
+    {14020842536910002910ULL, 17375132579648049765ULL},
+    {6960468693586999030ULL, 2874501009399359512ULL},
+    {15848664463482628822ULL, 2112125920842202884ULL},
+    {15806103445395303132ULL, 4418780217002269030ULL},
+    {9622945936699253079ULL, 2952175868681624967ULL},
+    {12229807327398664305ULL, 2155368196232016253ULL},
+    {13021847938196588887ULL, 11474248208877610456ULL},
+    {14151501482032275739ULL, 10609423643184248428ULL},
+    {3134776296903512174ULL, 8594586722790476745ULL},
+    {6342371571090607558ULL, 4984590344667104013ULL},
+    {11516306451445884484ULL, 7603798593727219227ULL},
+    {6273524907368301850ULL, 5099931823395560041ULL},
+    {2143214176255137500ULL, 7966077873055828754ULL},
+    {15208464991501160450ULL, 8277536939835245728ULL},
+    {2350419968193829789ULL, 12156134644063901380ULL},
+    {7424736113637498731ULL, 14161553488145475951ULL},
+    {18296789775421313607ULL, 11763061973423474061ULL},
+    {2604719807785712442ULL, 13143341436398624279ULL},
+    {2087182813613934615ULL, 15164461159771984625ULL},
+    {16262396249537712762ULL, 7241624729201059840ULL},
+    {18220648873239813996ULL, 11307679004851221775ULL},
+    {1904452952566687049ULL, 16754174625582087014ULL},
+    {17698764726416280828ULL, 13888964736192759251ULL},
+    {15031524024242133530ULL, 3072932459939316490ULL},
+    {6278479983805196547ULL, 6960827234146477530ULL},
+    {2316163579240305244ULL, 12472251766814164435ULL},
+    {10930137787738805599ULL, 12805373966160745898ULL},
+    {2870996599780940844ULL, 7221199597418657048ULL},
+    {10607730210180889410ULL, 1262686964280342567ULL},
+    {5520390397638332335ULL, 324909315735296136ULL},
+    {9715650854824683708ULL, 2506839328423855365ULL},
+    {15291027277119557462ULL, 10883992772893094363ULL},
+    {6577651006151466670ULL, 5905329205390212770ULL},
+    {10550280027134033911ULL, 12169847313466412195ULL},
+    {96321498225926877ULL, 9906445358737093679ULL},
+    {13367596817938700213ULL, 799094893086177136ULL},
+    {1167481277742666272ULL, 16086462745211720056ULL},
+    {115544193707590104ULL, 4976049903647391420ULL},
+    {11000025064277734173ULL, 15697653485420162637ULL},
+    {4587238637292747128ULL, 5309472281254710354ULL},
+    {11718705174144691303ULL, 16177572126077600290ULL},
+    {4997810084781295850ULL, 8716895896415155937ULL},
+    {5787610783442145126ULL, 12870909047319746932ULL},
+    {5519724165420616309ULL, 5268689978675462457ULL},
+    {1667516874705481561ULL, 4713844854256342275ULL},
+    {17009410395504744653ULL, 3289387836259004579ULL},
+    {14283361548304607868ULL, 1846211411319356041ULL},
+    {7489613335297791071ULL, 12266966685248692346ULL},
+    {14539243853879318377ULL, 1484921826372117532ULL},
+    {3159387339126387553ULL, 8953529060196893019ULL},
+    {17443649335784618339ULL, 1006875547714043278ULL},
+};
+
+struct Mmh3GoldenVector {
+    int k;
+    int count;
+    const uint64_t (*hashes)[2];
+};
+
+const int MMH3_GOLDEN_NUM_VECTORS = 3;
+const Mmh3GoldenVector MMH3_GOLDEN_VECTORS[MMH3_GOLDEN_NUM_VECTORS] = {
+    {21, 130, MMH3_GOLDEN_HASHES_21},
+    {31, 120, MMH3_GOLDEN_HASHES_31},
+    {51, 100, MMH3_GOLDEN_HASHES_51},
+};
+
+#endif
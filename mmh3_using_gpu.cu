@@ -7,6 +7,8 @@
 #include <string>
 #include <fstream>
 
+#include "sequence_reader.hpp"
+
 using namespace std;
 
 __device__ uint64_t rotateLeft(uint64_t x, int r)
@@ -146,40 +148,56 @@ __global__ void hashKernel(const void *input_string, int k, uint32_t seed, void
     
 }
 
-// Host function to allocate memory and copy data
-// arguments: input_string, input_string_length, seed, out, k
-void hashOnGPU(const void *input_string, int input_string_length, uint32_t seed, void *out, int k)
+// device buffers for hashing one block of bases at a time, allocated once for the largest block,
+// and the time spent in every step over all blocks
+struct GPUHasher
+{
+    void *d_key = nullptr;
+    void *d_out = nullptr;
+    size_t max_length = 0;
+    double copy_to_device_time = 0;
+    double kernel_time = 0;
+    double copy_to_host_time = 0;
+};
+
+void allocateGPUHasher(GPUHasher &hasher, size_t max_length, int k)
 {
-    int num_kmers = input_string_length - k + 1;
-    // num_kmers = 2;
-
-    // allocate memory on device
-    void *d_key;
-    void *d_out;
-
     double time_snap = clock();
 
-    cudaMalloc(&d_key, input_string_length);
-    cudaMalloc(&d_out, sizeof(uint64_t) * 2 * num_kmers); // two 64-bit integers for each k-mer
+    cudaMalloc(&hasher.d_key, max_length);
+    cudaMalloc(&hasher.d_out, sizeof(uint64_t) * 2 * (max_length - k + 1)); // two 64-bit integers for each k-mer
+    hasher.max_length = max_length;
 
     double time_snap2 = clock();
     std::cout << "Time taken for memory allocation: " << (time_snap2 - time_snap) / CLOCKS_PER_SEC << std::endl;
+}
+
+void freeGPUHasher(GPUHasher &hasher)
+{
+    cudaFree(hasher.d_key);
+    cudaFree(hasher.d_out);
+}
+
+// Host function to copy one block to the device, hash all its k-mers and copy the hashes back
+// arguments: hasher, input_string, input_string_length (at most hasher.max_length), seed, out, k
+void hashOnGPU(GPUHasher &hasher, const void *input_string, int input_string_length, uint32_t seed, void *out, int k)
+{
+    int num_kmers = input_string_length - k + 1;
+
+    double time_snap = clock();
 
     // copy data to device
-    cudaMemcpy(d_key, input_string, input_string_length, cudaMemcpyHostToDevice);
+    cudaMemcpy(hasher.d_key, input_string, input_string_length, cudaMemcpyHostToDevice);
 
-    double time_snap3 = clock();
-    std::cout << "Time taken for copying data to device: " << (time_snap3 - time_snap2) / CLOCKS_PER_SEC << std::endl;
+    double start_time = clock();
+    hasher.copy_to_device_time += start_time - time_snap;
 
     // determine the number of threads per block, number of blocks
     int threadsPerBlock = 256;
     int blocksPerGrid = (num_kmers + threadsPerBlock - 1) / threadsPerBlock;
 
-    // measure start and end time
-    double start_time = clock();
-
     // call kernel function
-    hashKernel <<<blocksPerGrid, threadsPerBlock>>> (d_key, k, seed, d_out, num_kmers);
+    hashKernel <<<blocksPerGrid, threadsPerBlock>>> (hasher.d_key, k, seed, hasher.d_out, num_kmers);
 
     // wait for the kernel to finish
     cudaError_t err = cudaDeviceSynchronize();
@@ -189,46 +207,12 @@ void hashOnGPU(const void *input_string, int input_string_length, uint32_t seed,
     }
 
     double end_time = clock();
-
-    std::cout << "Time taken for the kernel to run: " << (end_time - start_time) / CLOCKS_PER_SEC << std::endl;
+    hasher.kernel_time += end_time - start_time;
 
     // copy data back to host
-    cudaMemcpy(out, d_out, sizeof(uint64_t) * 2 * num_kmers, cudaMemcpyDeviceToHost);
-
-    double time_snap4 = clock();
-    std::cout << "Time taken for copying data back to host: " << (time_snap4 - end_time) / CLOCKS_PER_SEC << std::endl;
-
-    // free memory
-    cudaFree(d_key);
-    cudaFree(d_out);
+    cudaMemcpy(out, hasher.d_out, sizeof(uint64_t) * 2 * num_kmers, cudaMemcpyDeviceToHost);
 
-    double time_snap5 = clock();
-    std::cout << "Time taken for freeing memory: " << (time_snap5 - time_snap4) / CLOCKS_PER_SEC << std::endl;
-}
-
-void readFASTA(const std::string &filename, std::string &header, std::string &sequence)
-{
-    std::ifstream infile(filename);
-    if (!infile)
-    {
-        std::cerr << "Error opening file: " << filename << std::endl;
-        return;
-    }
-
-    std::string line;
-    while (std::getline(infile, line))
-    {
-        if (line[0] == '>')
-        {
-            header = line; // Store the header line
-        }
-        else
-        {
-            sequence += line; // Append to the sequence string
-        }
-    }
-
-    infile.close();
+    hasher.copy_to_host_time += clock() - end_time;
 }
 
 int main(int argc, char *argv[])
@@ -243,31 +227,43 @@ int main(int argc, char *argv[])
     std::string filename = argv[1];
     std::string out_filename = argv[2];
     std::string header;
-    std::string sequence;
-
-    readFASTA(filename, header, sequence);
 
-    const char *input_string = sequence.c_str();
-    int input_string_length = strlen(input_string);
     uint32_t seed = 0;
     int k = 21;
-    int num_kmers = input_string_length - k + 1;
-
-    uint64_t *out = new uint64_t[2 * num_kmers];
 
-    hashOnGPU(input_string, input_string_length, seed, out, k);
-    // wait for the kernel to finish
-    cudaDeviceSynchronize();
-
-    /*
-    std::ofstream outfile(out_filename);
-    for (int i = 0; i < num_kmers; i++)
+    // the records are read in blocks that overlap by k-1 bases, so no k-mer spans two records, and the
+    // host and device buffers have the size of one block for any genome size
+    SequenceReader reader(filename);
+    // a block holds the k-1 bases carried over and up to block_size new ones
+    size_t block_size = SequenceReader::CHUNK_SIZE;
+    size_t max_length = block_size + k - 1;
+    GPUHasher hasher;
+    allocateGPUHasher(hasher, max_length, k);
+    uint64_t *out = new uint64_t[2 * (max_length - k + 1)];
+
+    while (reader.next_record(header))
     {
-        string kmer = sequence.substr(i, k);
-        outfile << kmer << " " << out[2 * i] << " " << out[2 * i + 1] << std::endl;
+        for_each_kmer_block(reader, k, [&](const char *input_string, size_t input_string_length)
+        {
+            hashOnGPU(hasher, input_string, input_string_length, seed, out, k);
+
+            /*
+            int num_kmers = input_string_length - k + 1;
+            std::ofstream outfile(out_filename, std::ios::app);
+            for (int i = 0; i < num_kmers; i++)
+            {
+                string kmer(input_string + i, k);
+                outfile << kmer << " " << out[2 * i] << " " << out[2 * i + 1] << std::endl;
+            }
+            */
+        }, block_size);
     }
-    */
 
+    std::cout << "Time taken for copying data to device: " << hasher.copy_to_device_time / CLOCKS_PER_SEC << std::endl;
+    std::cout << "Time taken for the kernel to run: " << hasher.kernel_time / CLOCKS_PER_SEC << std::endl;
+    std::cout << "Time taken for copying data back to host: " << hasher.copy_to_host_time / CLOCKS_PER_SEC << std::endl;
+
+    freeGPUHasher(hasher);
     delete[] out;
 
     return 0;
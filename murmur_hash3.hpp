@@ -0,0 +1,309 @@
+#ifndef MURMUR_HASH3_HPP
+#define MURMUR_HASH3_HPP
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+// MurmurHash3_x64_128, the hash of sourmash's FracMinHash sketches (mmh3.hash64 in python; sourmash keeps
+// the first 64 bits, seed 42)
+
+#define ROTL64(x, y) rotl64(x, y)
+#define BIG_CONSTANT(x) (x)
+
+inline uint64_t getblock64(const uint64_t *p, int i)
+{
+    return p[i];
+}
+
+inline uint64_t rotl64(uint64_t x, int8_t r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= BIG_CONSTANT(0xff51afd7ed558ccd);
+    k ^= k >> 33;
+    k *= BIG_CONSTANT(0xc4ceb9fe1a85ec53);
+    k ^= k >> 33;
+
+    return k;
+}
+
+inline void MurmurHash3_x64_128(const void *key, const int len,
+                                const uint32_t seed, void *out)
+{
+    const uint8_t *data = (const uint8_t *)key;
+    const int nblocks = len / 16;
+
+    uint64_t h1 = seed;
+    uint64_t h2 = seed;
+
+    const uint64_t c1 = BIG_CONSTANT(0x87c37b91114253d5);
+    const uint64_t c2 = BIG_CONSTANT(0x4cf5ad432745937f);
+
+    //----------
+    // body
+
+    const uint64_t *blocks = (const uint64_t *)(data);
+
+    for (int i = 0; i < nblocks; i++)
+    {
+        uint64_t k1 = getblock64(blocks, i * 2 + 0);
+        uint64_t k2 = getblock64(blocks, i * 2 + 1);
+
+        k1 *= c1;
+        k1 = ROTL64(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+
+        h1 = ROTL64(h1, 27);
+        h1 += h2;
+        h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2;
+        k2 = ROTL64(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+
+        h2 = ROTL64(h2, 31);
+        h2 += h1;
+        h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    //----------
+    // tail
+
+    const uint8_t *tail = (const uint8_t *)(data + nblocks * 16);
+
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    switch (len & 15)
+    {
+    case 15:
+        k2 ^= ((uint64_t)tail[14]) << 48;
+    case 14:
+        k2 ^= ((uint64_t)tail[13]) << 40;
+    case 13:
+        k2 ^= ((uint64_t)tail[12]) << 32;
+    case 12:
+        k2 ^= ((uint64_t)tail[11]) << 24;
+    case 11:
+        k2 ^= ((uint64_t)tail[10]) << 16;
+    case 10:
+        k2 ^= ((uint64_t)tail[9]) << 8;
+    case 9:
+        k2 ^= ((uint64_t)tail[8]) << 0;
+        k2 *= c2;
+        k2 = ROTL64(k2, 33);
+        k2 *= c1;
+        h2 ^= k2;
+
+    case 8:
+        k1 ^= ((uint64_t)tail[7]) << 56;
+    case 7:
+        k1 ^= ((uint64_t)tail[6]) << 48;
+    case 6:
+        k1 ^= ((uint64_t)tail[5]) << 40;
+    case 5:
+        k1 ^= ((uint64_t)tail[4]) << 32;
+    case 4:
+        k1 ^= ((uint64_t)tail[3]) << 24;
+    case 3:
+        k1 ^= ((uint64_t)tail[2]) << 16;
+    case 2:
+        k1 ^= ((uint64_t)tail[1]) << 8;
+    case 1:
+        k1 ^= ((uint64_t)tail[0]) << 0;
+        k1 *= c1;
+        k1 = ROTL64(k1, 31);
+        k1 *= c2;
+        h1 ^= k1;
+    };
+
+    h1 ^= len;
+    h2 ^= len;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    ((uint64_t *)out)[0] = h1;
+    ((uint64_t *)out)[1] = h2;
+}
+
+
+// the same hash with the key length K fixed at compile time, for several keys at once: the block loop and
+// the tail are resolved by the compiler, and every 64-bit operation runs on all lanes of a vector register.
+// the lane types below wrap the instructions; MurmurLanes is 8 AVX-512 lanes when the build enables them
+// (-mavx512f -mavx512dq, or -march=native), and a single scalar lane otherwise. AVX2 has no 64-bit multiply,
+// and emulating it made 4 lanes slower than one scalar lane with K fixed
+
+inline uint64_t load_word(const char *p)
+{
+    uint64_t word;
+    memcpy(&word, p, 8);
+    return word;
+}
+
+struct MurmurLanesScalar
+{
+    static const int LANES = 1;
+    typedef uint64_t vec;
+    static vec load(const char *const *keys, int offset) { return load_word(keys[0] + offset); }
+    static void store(uint64_t *p, vec v) { *p = v; }
+    static vec set1(uint64_t x) { return x; }
+    static vec add(vec a, vec b) { return a + b; }
+    static vec bit_xor(vec a, vec b) { return a ^ b; }
+    static vec mul(vec a, vec b) { return a * b; }
+    template <int r> static vec rotl(vec x) { return rotl64(x, r); }
+    template <int r> static vec shr(vec x) { return x >> r; }
+    template <int r> static vec shl(vec x) { return x << r; }
+};
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+struct MurmurLanesAVX512
+{
+    static const int LANES = 8;
+    typedef __m512i vec;
+    static vec load(const char *const *keys, int offset)
+    {
+        return _mm512_set_epi64(load_word(keys[7] + offset), load_word(keys[6] + offset), load_word(keys[5] + offset), load_word(keys[4] + offset),
+                                load_word(keys[3] + offset), load_word(keys[2] + offset), load_word(keys[1] + offset), load_word(keys[0] + offset));
+    }
+    static void store(uint64_t *p, vec v) { _mm512_storeu_si512(p, v); }
+    static vec set1(uint64_t x) { return _mm512_set1_epi64(x); }
+    static vec add(vec a, vec b) { return _mm512_add_epi64(a, b); }
+    static vec bit_xor(vec a, vec b) { return _mm512_xor_si512(a, b); }
+    static vec mul(vec a, vec b) { return _mm512_mullo_epi64(a, b); }
+    template <int r> static vec rotl(vec x) { return _mm512_rol_epi64(x, r); }
+    template <int r> static vec shr(vec x) { return _mm512_srli_epi64(x, r); }
+    template <int r> static vec shl(vec x) { return _mm512_slli_epi64(x, r); }
+};
+typedef MurmurLanesAVX512 MurmurLanes;
+#else
+typedef MurmurLanesScalar MurmurLanes;
+#endif
+
+template <typename L>
+inline typename L::vec fmix64_lanes(typename L::vec k)
+{
+    k = L::bit_xor(k, L::template shr<33>(k));
+    k = L::mul(k, L::set1(BIG_CONSTANT(0xff51afd7ed558ccd)));
+    k = L::bit_xor(k, L::template shr<33>(k));
+    k = L::mul(k, L::set1(BIG_CONSTANT(0xc4ceb9fe1a85ec53)));
+    k = L::bit_xor(k, L::template shr<33>(k));
+    return k;
+}
+
+// hashes the K bytes at keys[0 .. L::LANES), writing the two halves of every hash to h1_out and h2_out
+template <int K, typename L = MurmurLanes>
+inline void MurmurHash3_x64_128_lanes(const char *const *keys, const uint32_t seed, uint64_t *h1_out, uint64_t *h2_out)
+{
+    typedef typename L::vec vec;
+    const int nblocks = K / 16;
+    const int tail_length = K % 16;
+
+    const vec c1 = L::set1(BIG_CONSTANT(0x87c37b91114253d5));
+    const vec c2 = L::set1(BIG_CONSTANT(0x4cf5ad432745937f));
+
+    vec h1 = L::set1(seed);
+    vec h2 = L::set1(seed);
+
+    //----------
+    // body
+
+    for (int i = 0; i < nblocks; i++)
+    {
+        vec k1 = L::load(keys, 16 * i);
+        vec k2 = L::load(keys, 16 * i + 8);
+
+        k1 = L::mul(k1, c1);
+        k1 = L::template rotl<31>(k1);
+        k1 = L::mul(k1, c2);
+        h1 = L::bit_xor(h1, k1);
+
+        h1 = L::template rotl<27>(h1);
+        h1 = L::add(h1, h2);
+        h1 = L::add(L::add(L::template shl<2>(h1), h1), L::set1(0x52dce729));
+
+        k2 = L::mul(k2, c2);
+        k2 = L::template rotl<33>(k2);
+        k2 = L::mul(k2, c1);
+        h2 = L::bit_xor(h2, k2);
+
+        h2 = L::template rotl<31>(h2);
+        h2 = L::add(h2, h1);
+        h2 = L::add(L::add(L::template shl<2>(h2), h2), L::set1(0x38495ab5));
+    }
+
+    //----------
+    // tail: the little-endian words of the remaining bytes, as the switch of MurmurHash3_x64_128 builds them.
+    // a short word is read as the 8 bytes ending at the end of the key, shifted down, so no lane reads past its key
+
+    static_assert(K >= 8, "keys shorter than 8 bytes are not supported");
+
+    if constexpr (tail_length > 8)
+    {
+        vec k2 = L::template shr<8 * (16 - tail_length)>(L::load(keys, K - 8));
+        k2 = L::mul(k2, c2);
+        k2 = L::template rotl<33>(k2);
+        k2 = L::mul(k2, c1);
+        h2 = L::bit_xor(h2, k2);
+    }
+
+    if constexpr (tail_length > 0)
+    {
+        vec k1;
+        if constexpr (tail_length >= 8)
+        {
+            k1 = L::load(keys, 16 * nblocks);
+        }
+        else
+        {
+            k1 = L::template shr<8 * (8 - tail_length)>(L::load(keys, K - 8));
+        }
+        k1 = L::mul(k1, c1);
+        k1 = L::template rotl<31>(k1);
+        k1 = L::mul(k1, c2);
+        h1 = L::bit_xor(h1, k1);
+    }
+
+    //----------
+    // finalization
+
+    h1 = L::bit_xor(h1, L::set1(K));
+    h2 = L::bit_xor(h2, L::set1(K));
+
+    h1 = L::add(h1, h2);
+    h2 = L::add(h2, h1);
+
+    h1 = fmix64_lanes<L>(h1);
+    h2 = fmix64_lanes<L>(h2);
+
+    h1 = L::add(h1, h2);
+    h2 = L::add(h2, h1);
+
+    L::store(h1_out, h1);
+    L::store(h2_out, h2);
+}
+
+// one key of compile-time length, with the same output as MurmurHash3_x64_128(key, K, seed, out)
+template <int K>
+inline void MurmurHash3_x64_128_fixed(const char *key, const uint32_t seed, uint64_t *out)
+{
+    MurmurHash3_x64_128_lanes<K, MurmurLanesScalar>(&key, seed, out, out + 1);
+}
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef NPY_MATRIX_HPP
+#define NPY_MATRIX_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "text_output.hpp"
+
+// The all-vs-all jaccard matrix as sourmash compare writes it, shared by compute_bit_representation and
+// compute_by_gpu so both write the same .npy and labels files.
+
+
+// write an n x n float32 matrix as a .npy file (the format numpy.save and sourmash compare produce),
+// streaming blocks of rows that fill_row computes on demand, so the full matrix is never held in memory.
+// assumes a little-endian host
+inline void writeNpyMatrix(const std::string& filename, size_t n, const std::function<void(size_t, float*)>& fill_row, bool gzip_output) {
+    BackgroundFileWriter writer(filename, gzip_output);
+
+    // header: magic, version 1.0, header length, then a python dict padded so the data starts at a multiple of 64
+    std::string dict = "{'descr': '<f4', 'fortran_order': False, 'shape': (" + std::to_string(n) + ", " + std::to_string(n) + "), }";
+    size_t header_length = dict.size() + 1;
+    header_length += (64 - (10 + header_length) % 64) % 64;
+    dict.append(header_length - dict.size() - 1, ' ');
+    dict.push_back('\n');
+
+    std::vector<char> header = {'\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0, (char)(header_length & 0xff), (char)(header_length >> 8)};
+    header.insert(header.end(), dict.begin(), dict.end());
+    writer.write(std::move(header));
+
+    // about 8 MB of rows per block
+    size_t rows_per_block = std::max((size_t)1, (size_t)(8 << 20) / (std::max((size_t)1, n) * sizeof(float)));
+    for (size_t row_start = 0; row_start < n; row_start += rows_per_block) {
+        size_t row_end = std::min(n, row_start + rows_per_block);
+        std::vector<char> buffer((row_end - row_start) * n * sizeof(float));
+        float* values = (float*)buffer.data();
+        for (size_t i = row_start; i < row_end; i++) {
+            fill_row(i, values + (i - row_start) * n);
+        }
+        writer.write(std::move(buffer));
+    }
+
+    writer.close();
+}
+
+
+
+// sourmash compare writes the labels next to the matrix, one per line, as <matrix file>.labels.txt
+inline void writeLabels(const std::string& matrix_filename, const std::vector<std::string>& labels) {
+    std::ofstream outfile(matrix_filename + ".labels.txt");
+    for (const auto& label : labels) {
+        outfile << label << "\n";
+    }
+    outfile.close();
+}
+
+
+
+// .npy output is chosen by the output file name: name.npy, or name.npy.gz for gzip-compressed output
+inline bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+#endif
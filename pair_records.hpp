@@ -0,0 +1,194 @@
+#ifndef PAIR_RECORDS_HPP
+#define PAIR_RECORDS_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+// Binary output format of compute_by_all_hashes: a 32-byte header followed by fixed-width
+// 24-byte records, one per similar (query, match) pair. All values are little-endian.
+// The whole file may be gzip-compressed (merged output ending in .gz).
+//
+//   header: magic "PAIRREC1", version (u32), record size (u32), number of sketches (u64),
+//           containment threshold (f32), reserved (u32)
+//   record: query id (u32), match id (u32), intersection (u32),
+//           jaccard (f32), containment of query in match (f32), containment of match in query (f32)
+//
+// With numpy: np.fromfile(f, dtype=[('query_id','<u4'),('match_id','<u4'),('intersection','<u4'),
+// ('jaccard','<f4'),('containment','<f4'),('containment_other','<f4')], offset=32)
+
+struct PairRecordHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t num_sketches;
+    float containment_threshold;
+    uint32_t reserved;
+};
+
+struct PairRecord {
+    uint32_t query_id;
+    uint32_t match_id;
+    uint32_t intersection;
+    float jaccard;
+    float containment_query_in_match;
+    float containment_match_in_query;
+};
+
+static_assert(sizeof(PairRecordHeader) == 32, "unexpected padding in PairRecordHeader");
+static_assert(sizeof(PairRecord) == 24, "unexpected padding in PairRecord");
+
+const char PAIR_RECORD_MAGIC[8] = {'P', 'A', 'I', 'R', 'R', 'E', 'C', '1'};
+const uint32_t PAIR_RECORD_VERSION = 1;
+
+
+inline PairRecordHeader make_pair_record_header(uint64_t num_sketches, float containment_threshold) {
+    PairRecordHeader header;
+    memcpy(header.magic, PAIR_RECORD_MAGIC, sizeof(header.magic));
+    header.version = PAIR_RECORD_VERSION;
+    header.record_size = sizeof(PairRecord);
+    header.num_sketches = num_sketches;
+    header.containment_threshold = containment_threshold;
+    header.reserved = 0;
+    return header;
+}
+
+
+// collects records in a large buffer and writes them with one fwrite per block. a short write or a failed
+// close ends the run with a message and exit code 1, so no file holds fewer records than were added
+class PairRecordWriter {
+public:
+    static const size_t RECORDS_PER_BLOCK = 1 << 16;
+
+    PairRecordWriter(const std::string& filename, uint64_t num_sketches, float containment_threshold) : filename(filename) {
+        file = fopen(filename.c_str(), "wb");
+        if (!file) {
+            throw std::runtime_error("Failed to open output file: " + filename);
+        }
+        PairRecordHeader header = make_pair_record_header(num_sketches, containment_threshold);
+        if (fwrite(&header, sizeof(header), 1, file) != 1) {
+            fail();
+        }
+        buffer.reserve(RECORDS_PER_BLOCK);
+    }
+
+    ~PairRecordWriter() {
+        close();
+    }
+
+    void add(const PairRecord& record) {
+        buffer.push_back(record);
+        if (buffer.size() == RECORDS_PER_BLOCK) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (!buffer.empty()) {
+            if (fwrite(buffer.data(), sizeof(PairRecord), buffer.size(), file) != buffer.size()) {
+                fail();
+            }
+            buffer.clear();
+        }
+    }
+
+    void close() {
+        if (file) {
+            flush();
+            int status = fclose(file);
+            file = nullptr;
+            if (status != 0) {
+                fail();
+            }
+        }
+    }
+
+private:
+    void fail() {
+        std::cerr << "Failed to write output file: " << filename << ": " << strerror(errno) << std::endl;
+        std::exit(1);
+    }
+
+    std::string filename;
+    FILE* file = nullptr;
+    std::vector<PairRecord> buffer;
+};
+
+
+// reads a pair record file block by block; gzip-compressed files are read transparently
+class PairRecordReader {
+public:
+    PairRecordReader(const std::string& filename) : filename(filename) {
+        file = gzopen(filename.c_str(), "rb");
+        if (!file) {
+            throw std::runtime_error("Failed to open pair record file: " + filename);
+        }
+        gzbuffer(file, 1 << 20);
+        if (gzread(file, &header, sizeof(header)) != (int)sizeof(header)
+            || memcmp(header.magic, PAIR_RECORD_MAGIC, sizeof(header.magic)) != 0
+            || header.record_size != sizeof(PairRecord)) {
+            gzclose(file);
+            throw std::runtime_error("Not a pair record file: " + filename);
+        }
+    }
+
+    ~PairRecordReader() {
+        if (file) {
+            gzclose(file);
+        }
+    }
+
+    uint64_t num_sketches() const {
+        return header.num_sketches;
+    }
+
+    float containment_threshold() const {
+        return header.containment_threshold;
+    }
+
+    // replace the contents of records with up to max_records next records; false at end of file. a read error,
+    // a truncated gzip stream or a file ending in a partial record throws, so no records are lost silently
+    bool read_block(std::vector<PairRecord>& records, size_t max_records = PairRecordWriter::RECORDS_PER_BLOCK) {
+        records.resize(max_records);
+        int bytes_read = gzread(file, records.data(), max_records * sizeof(PairRecord));
+        int errnum = Z_OK;
+        const char* message = gzerror(file, &errnum);
+        if (bytes_read < 0 || errnum != Z_OK) {
+            // the zlib message already names the file
+            throw std::runtime_error(std::string("Failed to read pair record file: ") + message);
+        }
+        if (bytes_read % sizeof(PairRecord) != 0) {
+            throw std::runtime_error("Pair record file ends in a partial record: " + filename);
+        }
+        records.resize(bytes_read / sizeof(PairRecord));
+        return !records.empty();
+    }
+
+private:
+    std::string filename;
+    gzFile file = nullptr;
+    PairRecordHeader header;
+};
+
+
+// true if the file starts with the pair record magic, so tools can accept either text or binary outputs
+inline bool is_pair_record_file(const std::string& filename) {
+    gzFile file = gzopen(filename.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char magic[sizeof(PAIR_RECORD_MAGIC)];
+    bool matches = gzread(file, magic, sizeof(magic)) == (int)sizeof(magic) && memcmp(magic, PAIR_RECORD_MAGIC, sizeof(magic)) == 0;
+    gzclose(file);
+    return matches;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+
+#include "pair_records.hpp"
+#include "text_output.hpp"
+
+using namespace std;
+
+
+// convert binary pair records (compute_by_all_hashes --format binary) to the text format of the
+// text output: query_id,match_id,jaccard,containment,containment_other, one pair per line
+
+
+vector<string> get_record_file_names(const string& input) {
+    // the input is either one record file, or a list of record files such as by_index_file_names.txt
+    if (is_pair_record_file(input)) {
+        return {input};
+    }
+
+    vector<string> filenames;
+    ifstream file(input);
+    if (!file.is_open()) {
+        cerr << "Could not open the file: " << input << endl;
+        exit(1);
+    }
+    string line;
+    while (getline(file, line)) {
+        if (!line.empty()) {
+            filenames.push_back(line);
+        }
+    }
+    file.close();
+    return filenames;
+}
+
+
+int main(int argc, char* argv[]) {
+
+    // command line arguments: records file (or list of them), output csv
+    if (argc < 3 || argc > 5) {
+        cerr << "Usage: " << argv[0] << " <records_file_or_list> <out_csv> [with_intersection] [precision]" << endl;
+        return 1;
+    }
+
+    vector<string> filenames = get_record_file_names(argv[1]);
+    bool with_intersection = (argc >= 4) && stoi(argv[3]);
+    int precision = (argc == 5) ? stoi(argv[4]) : DEFAULT_TEXT_PRECISION;
+
+    TextWriter outfile(argv[2], precision);
+
+    size_t num_records = 0;
+    vector<PairRecord> records;
+    for (const auto& filename : filenames) {
+        try {
+            PairRecordReader reader(filename);
+            while (reader.read_block(records)) {
+                for (const auto& record : records) {
+                    outfile << record.query_id << "," << record.match_id << "," << record.jaccard << "," << record.containment_query_in_match << "," << record.containment_match_in_query;
+                    if (with_intersection) {
+                        outfile << "," << record.intersection;
+                    }
+                    outfile << '\n';
+                }
+                num_records += records.size();
+            }
+        } catch (const runtime_error& e) {
+            cerr << e.what() << endl;
+            return 1;
+        }
+    }
+
+    outfile.close();
+    cout << "Converted " << num_records << " records from " << filenames.size() << " files" << endl;
+
+    return 0;
+}
@@ -9,11 +9,17 @@
 #include <thread>
 #include <mutex>
 #include "json.hpp"
+#include "text_output.hpp"
 #include <zlib.h>
 #include <chrono>
 #include <string>
 #include <sstream>
 #include <thread>
+#include <atomic>
+#include <cmath>
+#include "similar_edges.hpp"
+#include "sketch_info.hpp"
+#include "thread_pool.hpp"
 
 
 using json = nlohmann::json;
@@ -22,74 +28,146 @@ using namespace std;
 typedef unsigned long long int hash_t;
 
 vector<string> sketch_names;
-vector<vector<hash_t>> sketches;
+vector<int> sketch_sizes;
 int num_sketches;
 int num_threads = 1;
+// the workers of every parallel stage, started once
+Eigen::ThreadPool* thread_pool = nullptr;
 int count_empty_sketch = 0;
 mutex mutex_count_empty_sketch;
 vector<pair<int, int>> genome_id_size_pairs;
-vector<vector<int>> similars;
-
-
+// adjacency in CSR form: the similars of genome i are similar_neighbours[similar_offsets[i] .. similar_offsets[i+1])
+vector<long long> similar_offsets;
+vector<int> similar_neighbours;
+// the metrics of every edge, parallel to similar_neighbours; the containment is of genome i in its similar
+vector<float> similar_jaccards;
+vector<float> similar_containments;
+// k-mer size the sketches were built with, to turn containment into ANI
+int ksize = 31;
+
+// a stricter threshold to dereplicate with, on the edges already loaded
+enum class EdgeMetric { NONE, CONTAINMENT, JACCARD, ANI };
+
+struct EdgeFilter {
+    EdgeMetric metric = EdgeMetric::NONE;
+    float min_value = 0;
+    string output_filename;
+};
+
+// containment to ANI, as sourmash does: ani = containment^(1/k)
+inline float containment_to_ani(float containment) {
+    return containment > 0 ? pow(containment, 1.0f / ksize) : 0.0f;
+}
 
-void read_similar_info_one_file(string filename) {
-    
-    ifstream simFile(filename);
-    if (!simFile.is_open()) {
-        cerr << "Could not open the file: " << filename << endl;
-        exit(1);
+inline bool edge_passes(long long j, const EdgeFilter& filter) {
+    switch (filter.metric) {
+        case EdgeMetric::CONTAINMENT: return similar_containments[j] >= filter.min_value;
+        case EdgeMetric::JACCARD: return similar_jaccards[j] >= filter.min_value;
+        case EdgeMetric::ANI: return containment_to_ani(similar_containments[j]) >= filter.min_value;
+        default: return true;
     }
-    string simPairLine;
-    while (getline(simFile, simPairLine)) {
-        // each line looks like: id1,id2,sim1,sim2,sim3, comma separated
-        istringstream iss(simPairLine);
-        int id1, id2;
-        char ch;
-        iss >> id1;
-        iss >> ch;
-        iss >> id2;
-        similars[id1].push_back(id2);
-    }
-    simFile.close();
-
 }
 
 
 
-void read_similar_info(string simFileList, int num_threads) {
-    for (int i = 0; i < num_sketches; i++) {
-        similars.push_back(vector<int>());
-    }
+// the similarity files and their edges, one buffer per file, until the adjacency is built
+vector<string> similar_filenames;
+vector<vector<SimilarEdge>> file_edges;
 
+
+
+// submit one task per similarity file to parse it into its own edge buffer
+void read_similar_files(string simFileList, TaskGroup& tasks) {
     ifstream file(simFileList);
     if (!file.is_open()) {
         cerr << "Could not open the file: " << simFileList << endl;
         return;
     }
-    vector<string> filenames;
     string line;
     while (getline(file, line)) {
-        filenames.push_back(line);
+        similar_filenames.push_back(line);
     }
     file.close();
 
-    // read the similar info, one thread for one file
-    int num_processed = 0;
-    int to_process = filenames.size();
-    while (num_processed < to_process) {
-        vector<thread> threads;
-        for (int i = 0; i < num_threads; i++) {
-            if (num_processed == to_process) {
-                break;
+    file_edges.assign(similar_filenames.size(), vector<SimilarEdge>());
+    for (int f = 0; f < similar_filenames.size(); f++) {
+        tasks.run([f]() {
+            for_each_similar_edge(similar_filenames[f], [&](const SimilarEdge& edge) {
+                file_edges[f].push_back(edge);
+            });
+        });
+    }
+}
+
+
+
+// the CSR adjacency from the parsed files
+void build_similar_info() {
+    int num_files = similar_filenames.size();
+    const vector<string>& filenames = similar_filenames;
+
+    // the edges in file order, split into equal slices; slice t goes to thread t in both sorting passes
+    vector<long long> file_start(num_files + 1, 0);
+    for (int f = 0; f < num_files; f++) {
+        file_start[f + 1] = file_start[f] + file_edges[f].size();
+        for (const auto& edge : file_edges[f]) {
+            if (edge.id1 < 0 || edge.id1 >= num_sketches || edge.id2 < 0 || edge.id2 >= num_sketches) {
+                cerr << "Invalid genome id in " << filenames[f] << ": " << edge.id1 << "," << edge.id2 << endl;
+                exit(1);
+            }
+        }
+    }
+    long long num_edges = file_start[num_files];
+
+    auto for_each_edge_in_slice = [&](int t, auto fn) {
+        long long lo = num_edges * t / num_threads;
+        long long hi = num_edges * (t + 1) / num_threads;
+        int f = upper_bound(file_start.begin(), file_start.end(), lo) - file_start.begin() - 1;
+        for (long long e = lo; e < hi; f++) {
+            long long last = min(hi, file_start[f + 1]);
+            for (; e < last; e++) {
+                fn(file_edges[f][e - file_start[f]]);
             }
-            threads.push_back(thread(read_similar_info_one_file, filenames[num_processed]));
-            num_processed++;
         }
-        for (int i = 0; i < threads.size(); i++) {
-            threads[i].join();
+    };
+
+    // counting sort, pass 1: degree of every genome within each slice
+    vector<vector<long long>> slice_counts(num_threads, vector<long long>(num_sketches, 0));
+    run_tasks(*thread_pool, num_threads, [&](int t) {
+        for_each_edge_in_slice(t, [&](const SimilarEdge& edge) {
+            slice_counts[t][edge.id1]++;
+        });
+    });
+
+    // offsets of every genome, and where each slice starts writing inside a genome's range
+    similar_offsets.assign(num_sketches + 1, 0);
+    for (int i = 0; i < num_sketches; i++) {
+        long long position = similar_offsets[i];
+        for (int t = 0; t < num_threads; t++) {
+            long long count = slice_counts[t][i];
+            slice_counts[t][i] = position;
+            position += count;
         }
+        similar_offsets[i + 1] = position;
     }
 
+    // counting sort, pass 2: scatter the neighbours and their metrics, keeping the file order within every genome
+    similar_neighbours.assign(num_edges, 0);
+    similar_jaccards.assign(num_edges, 0);
+    similar_containments.assign(num_edges, 0);
+    run_tasks(*thread_pool, num_threads, [&](int t) {
+        vector<long long>& cursor = slice_counts[t];
+        for_each_edge_in_slice(t, [&](const SimilarEdge& edge) {
+            long long position = cursor[edge.id1]++;
+            similar_neighbours[position] = edge.id2;
+            similar_jaccards[position] = edge.jaccard;
+            similar_containments[position] = edge.containment;
+        });
+    });
+    file_edges.clear();
+    file_edges.shrink_to_fit();
+
+    cout << "Loaded " << num_edges << " similar pairs from " << num_files << " files" << endl;
 }
 
 
@@ -120,45 +198,39 @@ vector<hash_t> read_min_hashes(const string& json_filename) {
 
 
 
-void read_sketches_one_chunk(int start_index, int end_index) {
-    for (int i = start_index; i < end_index; i++) {
-        auto min_hashes_genome_name = read_min_hashes(sketch_names[i]);
-        sketches[i] = min_hashes_genome_name;
-        if (sketches[i].size() == 0) {
-            mutex_count_empty_sketch.lock();
-            count_empty_sketch++;
-            mutex_count_empty_sketch.unlock();
-        }
-        genome_id_size_pairs[i] = {i, sketches[i].size()};
+void read_one_sketch(int i) {
+    sketch_sizes[i] = read_min_hashes(sketch_names[i]).size();
+    if (sketch_sizes[i] == 0) {
+        mutex_count_empty_sketch.lock();
+        count_empty_sketch++;
+        mutex_count_empty_sketch.unlock();
     }
+    genome_id_size_pairs[i] = {i, sketch_sizes[i]};
 }
 
 
 
 
-void read_sketches() {
+// submit one task per sketch; the sizes are there once the tasks are done
+void read_sketches(TaskGroup& tasks) {
     for (int i = 0; i < num_sketches; i++) {
-        sketches.push_back( vector<hash_t>() );
+        sketch_sizes.push_back(0);
         genome_id_size_pairs.push_back({-1, 0});
     }
+    for (int i = 0; i < num_sketches; i++) {
+        tasks.run([i]() { read_one_sketch(i); });
+    }
+}
 
 
-    int chunk_size = num_sketches / num_threads;
-    vector<thread> threads;
-    for (int i = 0; i < num_threads; i++) {
-        int start_index = i * chunk_size;
-        int end_index = (i == num_threads - 1) ? num_sketches : (i + 1) * chunk_size;
-        threads.push_back(thread(read_sketches_one_chunk, start_index, end_index));
-    }
-    for (int i = 0; i < num_threads; i++) {
-        threads[i].join();
-    }
+
+void show_empty_sketches() {
     // show the number of empty sketches
     cout << "Number of empty sketches: " << count_empty_sketch << endl;
 
     // show the ids of these empty sketches
     for (int i = 0; i < num_sketches; i++) {
-        if (sketches[i].size() == 0) {
+        if (sketch_sizes[i] == 0) {
             cout << i << " ";
         }
     }
@@ -168,6 +240,22 @@ void read_sketches() {
 
 
 
+// sizes from the sketch_info.tsv sidecar written by compute_by_all_hashes, instead of parsing every sketch
+void read_sketch_sizes(const string& sketch_info_filename) {
+    sketch_sizes = read_sketch_info(sketch_info_filename, num_sketches);
+    for (int i = 0; i < num_sketches; i++) {
+        genome_id_size_pairs.push_back({i, sketch_sizes[i]});
+        if (sketch_sizes[i] == 0) {
+            count_empty_sketch++;
+        }
+    }
+
+    cout << "Number of empty sketches: " << count_empty_sketch << endl;
+}
+
+
+
+
 void get_sketch_names(const std::string& filelist) {
     // the filelist is a file, where each line is a path to a sketch file
     std::ifstream file(filelist);
@@ -184,26 +272,202 @@ void get_sketch_names(const std::string& filelist) {
 
 
 
+// the greedy rule: walk the genomes from the smallest sketch to the largest (genome_id_size_pairs order),
+// and keep a genome unless one of its similars that is not excluded yet has a sketch at least as large.
+// only the edges passing filter count as similar
+vector<int> select_sequential(const EdgeFilter& filter) {
+    vector<int> selected_genome_ids;
+    vector<bool> genome_id_to_exclude(num_sketches, false);
+    for (int i = 0; i < num_sketches; i++) {
+        int genome_id_this = genome_id_size_pairs[i].first;
+        int size_this = genome_id_size_pairs[i].second;
+        bool select_this = true;
+        for (long long j = similar_offsets[genome_id_this]; j < similar_offsets[genome_id_this + 1]; j++) {
+            int genome_id_other = similar_neighbours[j];
+            if (genome_id_to_exclude[genome_id_other] || !edge_passes(j, filter)) {
+                continue;
+            }
+            int size_other = sketch_sizes[genome_id_other];
+            if (size_other >= size_this) {
+                select_this = false;
+                break;
+            }
+        }
+        if (select_this) {
+            selected_genome_ids.push_back(genome_id_this);
+        } else {
+            genome_id_to_exclude[genome_id_this] = true;
+        }
+    }
+    return selected_genome_ids;
+}
+
+
+
+// same selection as select_sequential, decided in parallel. when genome g is processed, a similar that comes
+// later in the order is never excluded and is at least as large, so it always rejects g. a similar that comes
+// earlier only matters if it has the same size and was selected. so g depends only on its earlier same-size
+// similars: one parallel sweep decides every genome without such dependencies, and rounds over the rest,
+// each deciding the genomes whose dependencies were all decided in earlier rounds, settle the tie chains
+vector<int> select_parallel(const EdgeFilter& filter) {
+    const char UNDECIDED = 0, SELECTED = 1, REJECTED = 2;
+
+    vector<int> position(num_sketches);
+    for (int i = 0; i < num_sketches; i++) {
+        position[genome_id_size_pairs[i].first] = i;
+    }
+
+    auto run_in_parallel = [&](long long n, auto fn) {
+        parallel_for(*thread_pool, n, fn);
+    };
+
+    // sweep: reject on a later similar, select when there is no earlier same-size similar
+    vector<char> state(num_sketches, UNDECIDED);
+    run_in_parallel(num_sketches, [&](long long g) {
+        bool has_dependency = false;
+        for (long long j = similar_offsets[g]; j < similar_offsets[g + 1]; j++) {
+            if (!edge_passes(j, filter)) {
+                continue;
+            }
+            int other = similar_neighbours[j];
+            if (position[other] >= position[g]) {
+                state[g] = REJECTED;
+                return;
+            }
+            if (sketch_sizes[other] == sketch_sizes[g]) {
+                has_dependency = true;
+            }
+        }
+        state[g] = has_dependency ? UNDECIDED : SELECTED;
+    });
+
+    vector<int> undecided;
+    for (int g = 0; g < num_sketches; g++) {
+        if (state[g] == UNDECIDED) {
+            undecided.push_back(g);
+        }
+    }
+
+    // rounds: every decision reads only the previous round's states, so the result does not depend on timing
+    int num_rounds = 0;
+    while (!undecided.empty()) {
+        vector<char> next_state(undecided.size(), UNDECIDED);
+        run_in_parallel(undecided.size(), [&](long long u) {
+            int g = undecided[u];
+            bool all_decided = true;
+            for (long long j = similar_offsets[g]; j < similar_offsets[g + 1]; j++) {
+                int other = similar_neighbours[j];
+                if (sketch_sizes[other] != sketch_sizes[g] || !edge_passes(j, filter)) {
+                    continue;
+                }
+                if (state[other] == SELECTED) {
+                    next_state[u] = REJECTED;
+                    return;
+                }
+                if (state[other] == UNDECIDED) {
+                    all_decided = false;
+                }
+            }
+            next_state[u] = all_decided ? SELECTED : UNDECIDED;
+        });
+
+        vector<int> still_undecided;
+        for (size_t u = 0; u < undecided.size(); u++) {
+            if (next_state[u] == UNDECIDED) {
+                still_undecided.push_back(undecided[u]);
+            } else {
+                state[undecided[u]] = next_state[u];
+            }
+        }
+        undecided.swap(still_undecided);
+        num_rounds++;
+    }
+    cout << "Dependency rounds: " << num_rounds << endl;
+
+    // report in processing order, like the sequential loop
+    vector<int> selected_genome_ids;
+    for (int i = 0; i < num_sketches; i++) {
+        if (state[genome_id_size_pairs[i].first] == SELECTED) {
+            selected_genome_ids.push_back(genome_id_size_pairs[i].first);
+        }
+    }
+    return selected_genome_ids;
+}
+
+
+
 int main(int argc, char* argv[]) {
 
-    // command line arguments: sigFileList simFileList numThreads
-    if (argc != 5) {
-        std::cerr << "Usage: " << argv[0] << " <sigFileList> <simFileList> <numThreads> <outFileName>" << std::endl;
+    // command line arguments: sigFileList simFileList numThreads outFileName [sketchInfoFile] [options]
+    if (argc < 5) {
+        std::cerr << "Usage: " << argv[0] << " <sigFileList> <simFileList> <numThreads> <outFileName> [sketchInfoFile] [options]" << std::endl;
+        std::cerr << "  sketchInfoFile: sketch_info.tsv written by compute_by_all_hashes; the sketches are not read when given" << std::endl;
+        std::cerr << "  --benchmark-selection: also run the sequential selection loop, time it, and check both agree" << std::endl;
+        std::cerr << "  --min-containment V[,V...]: also dereplicate keeping only edges with containment >= V, into <outFileName>.min_containment_V" << std::endl;
+        std::cerr << "  --min-jaccard V[,V...]: same with jaccard, into <outFileName>.min_jaccard_V" << std::endl;
+        std::cerr << "  --min-ani V[,V...]: same with the ANI estimated from containment, into <outFileName>.min_ani_V" << std::endl;
+        std::cerr << "  --ksize K: k-mer size of the sketches, for --min-ani (default 31)" << std::endl;
+        std::cerr << "  thresholds only make the similarity files stricter: pairs below the all-vs-all containment threshold are not in them" << std::endl;
         return 1;
     }
 
     string sigFileList = argv[1];
     string simFileList = argv[2];
     num_threads = stoi(argv[3]);
+    Eigen::ThreadPool pool(num_threads);
+    thread_pool = &pool;
     string outFileName = argv[4];
+    string sketchInfoFile;
+    bool benchmark_selection = false;
+    // the plain run on all loaded edges, then one run per threshold
+    vector<EdgeFilter> filters(1);
+    filters[0].output_filename = outFileName;
+    for (int i = 5; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--benchmark-selection") {
+            benchmark_selection = true;
+        } else if ((arg == "--min-containment" || arg == "--min-jaccard" || arg == "--min-ani") && i + 1 < argc) {
+            EdgeMetric metric = arg == "--min-containment" ? EdgeMetric::CONTAINMENT : arg == "--min-jaccard" ? EdgeMetric::JACCARD : EdgeMetric::ANI;
+            string values = argv[++i];
+            stringstream ss(values);
+            string value;
+            while (getline(ss, value, ',')) {
+                EdgeFilter filter;
+                filter.metric = metric;
+                filter.min_value = stof(value);
+                filter.output_filename = outFileName + "." + arg.substr(2, 3) + "_" + arg.substr(6) + "_" + value;
+                filters.push_back(filter);
+            }
+        } else if (arg == "--ksize" && i + 1 < argc) {
+            ksize = stoi(argv[++i]);
+        } else if (arg.rfind("--", 0) == 0 || !sketchInfoFile.empty()) {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        } else {
+            sketchInfoFile = arg;
+        }
+    }
 
-    // read the sketch files
+    // the sketches and the similarity files do not depend on each other, so they are parsed by the pool at the same time
     auto start_program = std::chrono::high_resolution_clock::now();
     get_sketch_names(sigFileList);
-    read_sketches();
+    cout << "Reading sketches and similar info..." << endl;
+    {
+        TaskGroup reading(*thread_pool);
+        read_similar_files(simFileList, reading);
+        if (!sketchInfoFile.empty()) {
+            read_sketch_sizes(sketchInfoFile);
+        } else {
+            read_sketches(reading);
+        }
+        reading.wait();
+    }
+    if (sketchInfoFile.empty()) {
+        show_empty_sketches();
+    }
 
     auto end_read = std::chrono::high_resolution_clock::now();
-    cout << "Time taken to read the sketches: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_read - start_program).count() << " milliseconds" << endl;
+    cout << "Time taken to read the sketches and similar files: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_read - start_program).count() << " milliseconds" << endl;
 
     // sort genome_id_size_pairs by size
     cout << "Sorting genome_id_size_pairs by size..." << endl;
@@ -216,67 +480,51 @@ int main(int argc, char* argv[]) {
 
     // show first 10 genome_id_size_pairs
     cout << "First 10 genome_id_size_pairs:" << endl;
-    for (int i = 0; i < 10; i++) {
+    for (int i = 0; i < min(10, num_sketches); i++) {
         cout << genome_id_size_pairs[i].first << " " << genome_id_size_pairs[i].second << endl;
     }
 
-    // read the similar info
-    cout << "Reading similar info..." << endl;
-    read_similar_info(simFileList, num_threads);
+    // the adjacency of the parsed similar pairs
+    build_similar_info();
 
     auto end_sim = std::chrono::high_resolution_clock::now();
-    cout << "Time taken to read similar info: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_sim - end_sort).count() << " milliseconds" << endl;
+    cout << "Time taken to build the similar info: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_sim - end_sort).count() << " milliseconds" << endl;
 
-    // start processing
-    cout << "Start processing..." << endl;
-    vector<int> selected_genome_ids;
-    vector<bool> genome_id_to_exclude(num_sketches, false);
-    for (int i = 0; i < num_sketches; i++) {
-        cout << "Processing " << i << "..." << '\r';
-        int genome_id_this = genome_id_size_pairs[i].first;
-        int size_this = genome_id_size_pairs[i].second;
-        bool select_this = true;
-        // show my size
-        for (int j = 0; j < similars[genome_id_this].size(); j++) {
-            int genome_id_other = similars[genome_id_this][j];
-            if (genome_id_to_exclude[genome_id_other]) {
-                continue;
-            }
-            int size_other = sketches[genome_id_other].size();
-            if (size_other >= size_this) {
-                select_this = false;
-                break;
-            }
+    // dereplicate once per threshold, all on the same loaded edges
+    for (const auto& filter : filters) {
+        if (filter.metric != EdgeMetric::NONE) {
+            cout << "Dereplicating into " << filter.output_filename << endl;
         }
-        if (select_this) {
-            selected_genome_ids.push_back(genome_id_this);
-        } else {
-            genome_id_to_exclude[genome_id_this] = true;
+
+        // start processing
+        auto start_processing = std::chrono::high_resolution_clock::now();
+        cout << "Start processing..." << endl;
+        vector<int> selected_genome_ids = select_parallel(filter);
+
+        auto end = std::chrono::high_resolution_clock::now();
+        cout << "Time taken for processing: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start_processing).count() << " milliseconds" << endl;
+
+        // time the sequential loop on the same input, and check that both select the same genomes
+        if (benchmark_selection) {
+            auto start_sequential = std::chrono::high_resolution_clock::now();
+            vector<int> sequential_genome_ids = select_sequential(filter);
+            auto end_sequential = std::chrono::high_resolution_clock::now();
+            cout << "Time taken for sequential processing: " << std::chrono::duration_cast<std::chrono::milliseconds>(end_sequential - start_sequential).count() << " milliseconds" << endl;
+            if (sequential_genome_ids != selected_genome_ids) {
+                cerr << "Parallel and sequential selections differ" << endl;
+                return 1;
+            }
+            cout << "Parallel and sequential selections agree: " << selected_genome_ids.size() << " genomes" << endl;
         }
-    }
 
-    auto end = std::chrono::high_resolution_clock::now();
-    cout << "Time taken for processing: " << std::chrono::duration_cast<std::chrono::milliseconds>(end - end_sim).count() << " milliseconds" << endl;
-
-    // write the selected genome ids to file
-    ofstream outfile(outFileName);
-    for (int i = 0; i < selected_genome_ids.size(); i++) {
-        int genome_id = selected_genome_ids[i];
-        string sketch_name = sketch_names[genome_id];
-        // split using / and get the last part
-        //size_t found = sketch_name.find_last_of("/");
-        //if (found != string::npos) {
-        //    sketch_name = sketch_name.substr(found+1);
-        //}
-        // remove the extension
-        //found = sketch_name.find_last_of(".");
-        //if (found != string::npos) {
-        //    sketch_name = sketch_name.substr(0, found);
-        //}
-
-        outfile << sketch_name << endl;
+        // write the selected genome ids to file
+        TextWriter outfile(filter.output_filename);
+        for (int i = 0; i < selected_genome_ids.size(); i++) {
+            int genome_id = selected_genome_ids[i];
+            outfile << sketch_names[genome_id] << '\n';
+        }
+        outfile.close();
     }
-    outfile.close();
 
 
     return 0;
@@ -0,0 +1,531 @@
+#ifndef SEQUENCE_READER_HPP
+#define SEQUENCE_READER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+// Streaming FASTA/FASTQ reader: the file (plain or gzip-compressed) is read in fixed-size chunks and the
+// records come out one at a time, their bases in blocks, so memory does not grow with the genome.
+// bases are passed through as they are (lowercase, N); line breaks are dropped.
+//
+//     SequenceReader reader(filename);
+//     string name;
+//     while (reader.next_record(name)) {
+//         for_each_kmer_block(reader, k, [&](const char* bases, size_t length) { ... });
+//     }
+//
+// with inflate_threads > 0 the file is inflated on other threads and handed over through a ChunkRing, so
+// parsing and hashing overlap with zlib: a BGZF file (bgzip, the usual compression of large FASTQ) has its
+// blocks inflated by inflate_threads threads in parallel, any other file is read by one background thread.
+// a file that cannot be opened, read or inflated throws runtime_error, with the file name, from the constructor
+// or from the reading call that reaches the bad data
+
+
+// single-producer single-consumer ring of byte chunks, from the thread that inflates to the reader. lock-free:
+// head is only written by the producer and tail by the consumer, and a full or empty ring is waited out by yielding
+class ChunkRing {
+public:
+    static const size_t NUM_SLOTS = 4;
+
+    // producer: the next free slot to fill, or null once the consumer has stopped
+    std::vector<char>* acquire() {
+        size_t h = head.load(std::memory_order_relaxed);
+        while (h - tail.load(std::memory_order_acquire) == NUM_SLOTS) {
+            if (stopped.load(std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            std::this_thread::yield();
+        }
+        return &slots[h % NUM_SLOTS];
+    }
+
+    // producer: the acquired slot holds size bytes
+    void publish(size_t size) {
+        size_t h = head.load(std::memory_order_relaxed);
+        sizes[h % NUM_SLOTS] = size;
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // producer: no more chunks; error is empty unless the input could not be read
+    void finish(const std::string& message = "") {
+        error = message;
+        finished.store(true, std::memory_order_release);
+    }
+
+    // consumer: the oldest published chunk, kept until release(); false after the last one
+    bool next(const char*& data, size_t& size) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        while (head.load(std::memory_order_acquire) == t) {
+            if (finished.load(std::memory_order_acquire) && head.load(std::memory_order_acquire) == t) {
+                if (!error.empty()) {
+                    throw std::runtime_error(error);
+                }
+                return false;
+            }
+            std::this_thread::yield();
+        }
+        data = slots[t % NUM_SLOTS].data();
+        size = sizes[t % NUM_SLOTS];
+        return true;
+    }
+
+    void release() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // consumer: no more chunks are wanted, the producer may quit
+    void stop() {
+        stopped.store(true, std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<char> slots[NUM_SLOTS];
+    size_t sizes[NUM_SLOTS];
+    std::atomic<size_t> head{0};
+    std::atomic<size_t> tail{0};
+    std::atomic<bool> finished{false};
+    std::atomic<bool> stopped{false};
+    std::string error;
+};
+
+
+// BGZF: a series of gzip members of at most 64 KB each, whose header has a "BC" extra field with the member's size
+// minus 1, so the members can be found without inflating and inflated independently
+inline bool is_bgzf(FILE* file) {
+    unsigned char header[18];
+    size_t n = fread(header, 1, sizeof(header), file);
+    rewind(file);
+    return n == sizeof(header) && header[0] == 0x1f && header[1] == 0x8b && header[2] == 8 && (header[3] & 4) &&
+           header[10] == 6 && header[11] == 0 && header[12] == 'B' && header[13] == 'C' && header[14] == 2 && header[15] == 0;
+}
+
+
+// read the next BGZF member whole into member; false at the end of the file
+inline bool read_bgzf_member(FILE* file, std::vector<unsigned char>& member) {
+    member.resize(18);
+    size_t n = fread(member.data(), 1, 18, file);
+    if (n == 0) {
+        return false;
+    }
+    if (n != 18 || member[0] != 0x1f || member[1] != 0x8b || member[12] != 'B' || member[13] != 'C') {
+        throw std::runtime_error("Invalid BGZF block");
+    }
+    size_t member_size = (member[16] | (member[17] << 8)) + 1;
+    member.resize(member_size);
+    if (member_size < 26 || fread(member.data() + 18, 1, member_size - 18, file) != member_size - 18) {
+        throw std::runtime_error("Truncated BGZF block");
+    }
+    return true;
+}
+
+
+// the deflate data of a member sits between its 18-byte header and the 8-byte crc32/size footer
+inline void inflate_bgzf_member(const std::vector<unsigned char>& member, char* out, size_t out_size) {
+    // nothing to inflate, as in the EOF member that ends every BGZF file (out may be null then)
+    if (out_size == 0) {
+        return;
+    }
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    inflateInit2(&stream, -15);
+    stream.next_in = (Bytef*)member.data() + 18;
+    stream.avail_in = member.size() - 26;
+    stream.next_out = (Bytef*)out;
+    stream.avail_out = out_size;
+    int status = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    const unsigned char* footer = member.data() + member.size() - 8;
+    uint32_t crc = footer[0] | (footer[1] << 8) | (footer[2] << 16) | ((uint32_t)footer[3] << 24);
+    if (status != Z_STREAM_END || stream.total_out != out_size || crc32(0, (const Bytef*)out, out_size) != crc) {
+        throw std::runtime_error("Corrupt BGZF block");
+    }
+}
+
+
+// the threads inflating the members of a BGZF file with its producer, started once per file. each batch of
+// members is inflated straight to their offsets in out, known from the sizes in the footers
+class BgzfInflaters {
+public:
+    BgzfInflaters(int num_threads) {
+        for (int t = 1; t < num_threads; t++) {
+            threads.push_back(std::thread(&BgzfInflaters::work, this));
+        }
+    }
+
+    ~BgzfInflaters() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        start.notify_all();
+        for (auto& th : threads) {
+            th.join();
+        }
+    }
+
+    // inflate members [0, num_members) on all the threads, this one included; returns when they are done
+    void inflate(const std::vector<std::vector<unsigned char>>& batch_members, const std::vector<size_t>& batch_offsets, size_t batch_size, char* batch_out) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            members = &batch_members;
+            offsets = &batch_offsets;
+            num_members = batch_size;
+            out = batch_out;
+            next_member = 0;
+            failed = false;
+            working = threads.size();
+            batch++;
+        }
+        start.notify_all();
+        inflate_members();
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return working == 0; });
+        if (failed) {
+            throw std::runtime_error("Corrupt BGZF block");
+        }
+    }
+
+private:
+    void work() {
+        size_t batches_seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start.wait(lock, [&]() { return quit || batch != batches_seen; });
+                if (quit) {
+                    return;
+                }
+                batches_seen = batch;
+            }
+            inflate_members();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--working == 0) {
+                done.notify_all();
+            }
+        }
+    }
+
+    void inflate_members() {
+        try {
+            for (size_t m = next_member++; m < num_members; m = next_member++) {
+                inflate_bgzf_member((*members)[m], out + (*offsets)[m], (*offsets)[m + 1] - (*offsets)[m]);
+            }
+        } catch (const std::exception&) {
+            failed = true;
+        }
+    }
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    bool quit = false;
+    size_t batch = 0;
+    size_t working = 0;
+    const std::vector<std::vector<unsigned char>>* members = nullptr;
+    const std::vector<size_t>* offsets = nullptr;
+    size_t num_members = 0;
+    char* out = nullptr;
+    std::atomic<size_t> next_member{0};
+    std::atomic<bool> failed{false};
+};
+
+
+// producer of a BGZF file: batches of up to MEMBERS_PER_CHUNK members are read and inflated to one slot each
+inline void inflate_bgzf(FILE* file, ChunkRing& ring, int num_threads) {
+    const size_t MEMBERS_PER_CHUNK = 64;
+    std::vector<std::vector<unsigned char>> members(MEMBERS_PER_CHUNK);
+    std::vector<size_t> offsets(MEMBERS_PER_CHUNK + 1);
+    BgzfInflaters inflaters(num_threads);
+    while (true) {
+        size_t num_members = 0;
+        while (num_members < MEMBERS_PER_CHUNK && read_bgzf_member(file, members[num_members])) {
+            const unsigned char* footer = members[num_members].data() + members[num_members].size() - 4;
+            size_t size = footer[0] | (footer[1] << 8) | (footer[2] << 16) | ((size_t)footer[3] << 24);
+            offsets[num_members + 1] = offsets[num_members] + size;
+            num_members++;
+        }
+        if (num_members == 0) {
+            return;
+        }
+        std::vector<char>* slot = ring.acquire();
+        if (!slot) {
+            return;
+        }
+        slot->resize(offsets[num_members]);
+        inflaters.inflate(members, offsets, num_members, slot->data());
+        ring.publish(offsets[num_members]);
+    }
+}
+
+
+// gzread returns 0 both at the end of the file and at the end of a truncated one, only gzerror tells them
+// apart; the error message (which starts with the path), or empty
+inline std::string gz_error(gzFile file) {
+    int errnum;
+    const char* message = gzerror(file, &errnum);
+    return errnum == Z_OK ? "" : message;
+}
+
+
+// producer of any other file, gzip-compressed or not: zlib on one thread, in chunks of chunk_size
+inline void inflate_gzip(gzFile file, ChunkRing& ring, size_t chunk_size) {
+    while (true) {
+        std::vector<char>* slot = ring.acquire();
+        if (!slot) {
+            return;
+        }
+        slot->resize(chunk_size);
+        int bytes_read = gzread(file, slot->data(), chunk_size);
+        if (bytes_read <= 0) {
+            std::string error = gz_error(file);
+            if (!error.empty()) {
+                throw std::runtime_error(error);
+            }
+            return;
+        }
+        ring.publish(bytes_read);
+    }
+}
+
+
+class SequenceReader {
+public:
+    static const size_t CHUNK_SIZE = 1 << 20;
+
+    SequenceReader(const std::string& filename, int inflate_threads = 0) : filename(filename) {
+        FILE* raw = inflate_threads > 0 ? fopen(filename.c_str(), "rb") : nullptr;
+        if (raw && is_bgzf(raw)) {
+            bgzf_file = raw;
+            ring.reset(new ChunkRing());
+            producer = std::thread(&SequenceReader::produce, this, inflate_threads);
+            return;
+        }
+        if (raw) {
+            fclose(raw);
+        }
+
+        file = gzopen(filename.c_str(), "rb");
+        if (!file) {
+            throw std::runtime_error("Could not open the file: " + filename);
+        }
+        gzbuffer(file, CHUNK_SIZE);
+        if (inflate_threads > 0) {
+            ring.reset(new ChunkRing());
+            producer = std::thread(&SequenceReader::produce, this, inflate_threads);
+        } else {
+            chunk.resize(CHUNK_SIZE);
+        }
+    }
+
+    ~SequenceReader() {
+        if (ring) {
+            ring->stop();
+            producer.join();
+        }
+        if (file) {
+            gzclose(file);
+        }
+        if (bgzf_file) {
+            fclose(bgzf_file);
+        }
+    }
+
+    // skip to the next record header and read its name (the header line without '>' or '@');
+    // false when there are no more records
+    bool next_record(std::string& name) {
+        // the rest of the current record
+        while (in_record && read_bases(nullptr, CHUNK_SIZE) > 0) {
+        }
+        in_record = false;
+
+        int c;
+        while ((c = next_char()) != EOF) {
+            if (at_line_start && (c == '>' || c == '@')) {
+                fastq = (c == '@');
+                name.clear();
+                while ((c = next_char()) != EOF && c != '\n') {
+                    name += (char)c;
+                }
+                if (!name.empty() && name.back() == '\r') {
+                    name.pop_back();
+                }
+                at_line_start = true;
+                in_record = true;
+                return true;
+            }
+            at_line_start = (c == '\n');
+        }
+        return false;
+    }
+
+    // copy up to max_length next bases of the current record to dst (dst may be null to skip them);
+    // returns fewer only at the end of the record, and 0 after it
+    size_t read_bases(char* dst, size_t max_length) {
+        size_t length = 0;
+        while (in_record && length < max_length) {
+            if (position == available && !fill()) {
+                in_record = false;
+                break;
+            }
+            // a new line starting with the next header ends a fasta record
+            if (at_line_start && !fastq && data[position] == '>') {
+                in_record = false;
+                break;
+            }
+            // copy the rest of the line
+            const char* start = data + position;
+            size_t line_rest = available - position;
+            const char* newline = (const char*)memchr(start, '\n', line_rest);
+            size_t n = std::min(newline ? (size_t)(newline - start) : line_rest, max_length - length);
+            size_t copied = n;
+            if (n > 0 && start[n - 1] == '\r') {
+                copied--;
+            }
+            if (dst) {
+                memcpy(dst + length, start, copied);
+            }
+            length += copied;
+            position += n;
+            at_line_start = false;
+            if (position < available && data[position] == '\n') {
+                position++;
+                at_line_start = true;
+                // fastq: one sequence line, then the '+' line and the qualities, which are skipped
+                if (fastq) {
+                    skip_line();
+                    skip_line();
+                    in_record = false;
+                }
+            }
+        }
+        return length;
+    }
+
+    // the buffer of for_each_block, kept for the next record: a FASTQ file has millions of short ones
+    std::vector<char> block_buffer;
+
+private:
+    // the producer thread: its errors end the ring and are thrown by the reading call that reaches them
+    void produce(int inflate_threads) {
+        try {
+            if (bgzf_file) {
+                inflate_bgzf(bgzf_file, *ring, inflate_threads);
+            } else {
+                inflate_gzip(file, *ring, CHUNK_SIZE);
+            }
+        } catch (const std::exception& e) {
+            // zlib's messages already name the file
+            ring->finish(bgzf_file ? filename + ": " + e.what() : e.what());
+            return;
+        }
+        ring->finish();
+    }
+
+    // the next chunk: from the ring, or read here
+    bool fill() {
+        position = 0;
+        available = 0;
+        if (ring) {
+            if (holding_chunk) {
+                ring->release();
+                holding_chunk = false;
+            }
+            while (available == 0) {
+                if (!ring->next(data, available)) {
+                    return false;
+                }
+                holding_chunk = true;
+                if (available == 0) {
+                    ring->release();
+                    holding_chunk = false;
+                }
+            }
+            return true;
+        }
+        int bytes_read = gzread(file, chunk.data(), chunk.size());
+        if (bytes_read <= 0 && !gz_error(file).empty()) {
+            throw std::runtime_error(gz_error(file));
+        }
+        data = chunk.data();
+        available = bytes_read > 0 ? bytes_read : 0;
+        return available > 0;
+    }
+
+    int next_char() {
+        if (position == available && !fill()) {
+            return EOF;
+        }
+        return (unsigned char)data[position++];
+    }
+
+    void skip_line() {
+        int c;
+        while ((c = next_char()) != EOF && c != '\n') {
+        }
+        at_line_start = true;
+    }
+
+    std::string filename;
+    gzFile file = nullptr;
+    FILE* bgzf_file = nullptr;
+    std::vector<char> chunk;
+    std::unique_ptr<ChunkRing> ring;
+    std::thread producer;
+    bool holding_chunk = false;
+    const char* data = nullptr;
+    size_t position = 0;
+    size_t available = 0;
+    bool at_line_start = true;
+    bool in_record = false;
+    bool fastq = false;
+};
+
+
+// call fn(bases, length, carried) on blocks of the current record's bases, each starting with the last
+// `overlap` bases of the block before it (carried of them: fewer in the first block, or after a short one),
+// followed by at most block_size new bases
+template <typename Fn>
+void for_each_block(SequenceReader& reader, size_t overlap, Fn fn, size_t block_size = SequenceReader::CHUNK_SIZE) {
+    std::vector<char>& block = reader.block_buffer;
+    if (block.size() < overlap + block_size) {
+        block.resize(overlap + block_size);
+    }
+    size_t kept = 0;
+    while (true) {
+        size_t n = reader.read_bases(block.data() + kept, block_size);
+        if (n == 0) {
+            break;
+        }
+        size_t length = kept + n;
+        fn((const char*)block.data(), length, kept);
+        size_t next_kept = std::min(overlap, length);
+        memmove(block.data(), block.data() + length - next_kept, next_kept);
+        kept = next_kept;
+    }
+}
+
+
+// call fn(bases, length) on blocks of the current record's bases. consecutive blocks overlap by k-1 bases, so
+// every k-mer of the record is in exactly one block and none spans two records
+template <typename Fn>
+void for_each_kmer_block(SequenceReader& reader, int k, Fn fn, size_t block_size = SequenceReader::CHUNK_SIZE) {
+    for_each_block(reader, k - 1, [&](const char* bases, size_t length, size_t) {
+        if (length >= (size_t)k) {
+            fn(bases, length);
+        }
+    }, block_size);
+}
+
+#endif
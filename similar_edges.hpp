@@ -0,0 +1,185 @@
+#ifndef SIMILAR_EDGES_HPP
+#define SIMILAR_EDGES_HPP
+
+#include <cerrno>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pair_records.hpp"
+
+// Reading the similar pairs written by compute_by_all_hashes, shared by the tools that consume them.
+// A similarity file is either text, one pair per line: id1,id2,jaccard,containment,containment_other,
+// or binary pair records (pair_records.hpp). The containment is of id1 in id2.
+
+
+struct SimilarEdge {
+    int id1;
+    int id2;
+    float jaccard;
+    float containment;
+};
+
+
+// parse an unsigned integer starting at p, leaving p after its last digit
+inline int scan_int(const char*& p, const char* end) {
+    int value = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    return value;
+}
+
+
+// parse a float starting at p, leaving p after it
+inline float scan_float(const char*& p, const char* end) {
+    float value = 0;
+    p = std::from_chars(p, end, value).ptr;
+    return value;
+}
+
+
+inline void skip_comma(const char*& p, const char* end) {
+    if (p < end && *p == ',') {
+        p++;
+    }
+}
+
+
+// call fn(const SimilarEdge&) for every pair in the text lines of [p, end), which end at a line break or at end
+template <typename Fn>
+void parse_similar_edge_lines(const char* p, const char* end, Fn& fn) {
+    // lines that do not start with a digit (blank lines, headers) are skipped
+    while (p < end) {
+        if (*p >= '0' && *p <= '9') {
+            SimilarEdge edge;
+            edge.id1 = scan_int(p, end);
+            skip_comma(p, end);
+            edge.id2 = scan_int(p, end);
+            skip_comma(p, end);
+            edge.jaccard = scan_float(p, end);
+            skip_comma(p, end);
+            edge.containment = scan_float(p, end);
+            fn(edge);
+        }
+        const char* newline = (const char*)memchr(p, '\n', end - p);
+        p = newline ? newline + 1 : end;
+    }
+}
+
+
+// true if the file starts with the gzip magic bytes
+inline bool is_gzip_file(const std::string& filename) {
+    FILE* file = fopen(filename.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    unsigned char magic[2];
+    bool matches = fread(magic, 1, 2, file) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+    fclose(file);
+    return matches;
+}
+
+
+// gzip-compressed text (a merged output ending in .gz) is inflated in chunks, each parsed up to its last
+// complete line; the rest is carried to the next chunk
+template <typename Fn>
+void for_each_similar_edge_gzip(const std::string& filename, Fn& fn) {
+    gzFile file = gzopen(filename.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Could not open the file: " << filename << std::endl;
+        exit(1);
+    }
+    const size_t chunk_size = 1 << 20;
+    std::vector<char> buffer(chunk_size);
+    size_t kept = 0;
+    while (true) {
+        if (buffer.size() - kept < chunk_size) {
+            buffer.resize(kept + chunk_size);
+        }
+        int bytes_read = gzread(file, buffer.data() + kept, chunk_size);
+        // a truncated file also reads as 0 bytes, only gzerror tells it from the end (its message names the file)
+        int errnum = Z_OK;
+        const char* error = gzerror(file, &errnum);
+        if (bytes_read < 0 || errnum != Z_OK) {
+            std::cerr << "Could not read the file: " << error << std::endl;
+            exit(1);
+        }
+        if (bytes_read == 0) {
+            parse_similar_edge_lines(buffer.data(), buffer.data() + kept, fn);
+            break;
+        }
+        size_t available = kept + bytes_read;
+        const char* last_newline = (const char*)memrchr(buffer.data(), '\n', available);
+        size_t complete = last_newline ? last_newline + 1 - buffer.data() : 0;
+        parse_similar_edge_lines(buffer.data(), buffer.data() + complete, fn);
+        memmove(buffer.data(), buffer.data() + complete, available - complete);
+        kept = available - complete;
+    }
+    gzclose(file);
+}
+
+
+// call fn(const SimilarEdge&) for every pair in the file, in file order. plain text files are mapped, not read
+template <typename Fn>
+void for_each_similar_edge(const std::string& filename, Fn fn) {
+    if (is_pair_record_file(filename)) {
+        try {
+            PairRecordReader reader(filename);
+            std::vector<PairRecord> records;
+            while (reader.read_block(records)) {
+                for (const auto& record : records) {
+                    fn(SimilarEdge{(int)record.query_id, (int)record.match_id, record.jaccard, record.containment_query_in_match});
+                }
+            }
+        } catch (const std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            exit(1);
+        }
+        return;
+    }
+    if (is_gzip_file(filename)) {
+        for_each_similar_edge_gzip(filename, fn);
+        return;
+    }
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Could not open the file: " << filename << std::endl;
+        exit(1);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        std::cerr << "Could not stat the file: " << filename << ": " << strerror(errno) << std::endl;
+        exit(1);
+    }
+    size_t file_size = file_stat.st_size;
+    if (file_size == 0) {
+        close(fd);
+        return;
+    }
+
+    const char* data = (const char*)mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        std::cerr << "Could not map the file: " << filename << std::endl;
+        exit(1);
+    }
+    madvise((void*)data, file_size, MADV_SEQUENTIAL);
+
+    parse_similar_edge_lines(data, data + file_size, fn);
+
+    munmap((void*)data, file_size);
+    close(fd);
+}
+
+#endif
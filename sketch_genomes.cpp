@@ -0,0 +1,605 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <type_traits>
+#include <unordered_map>
+
+#include "json.hpp"
+#include "murmur_hash3.hpp"
+#include "sequence_reader.hpp"
+
+#include <zlib.h>
+
+using json = nlohmann::ordered_json;
+using namespace std;
+
+typedef unsigned long long int hash_t;
+
+
+// FracMinHash sketches of genomes, as `sourmash sketch dna -p k=31,scaled=1000` writes them: every canonical
+// k-mer (the smaller of the k-mer and its reverse complement) is hashed with MurmurHash3_x64_128 and the
+// first 64 bits are kept if they are at most max_hash = 2^64 / scaled. k-mers with a base other than ACGT
+// are skipped. all records of a file go into one sketch, named after the first record
+
+
+// the files of every genome or sample: usually one, or the several FASTQ files of one sequencing run
+vector<vector<string>> genome_files;
+vector<string> sketch_files;
+int num_threads = 1;
+// threads inflating each input besides the one sketching it (0: inflate on the sketching thread)
+int inflate_threads = 1;
+hash_t scaled = 1000;
+hash_t max_hash;
+
+// every combination of the requested k-mer sizes and seeds is sketched in the same read of a genome
+struct SketchParams {
+    int ksize;
+    uint32_t seed;
+};
+vector<SketchParams> sketch_params;
+string out_dir;
+bool gzip_output = false;
+
+// with abundance tracking every kept hash also counts how often its k-mer occurs, like `sourmash sketch
+// dna -p abund`; the md5 stays the one of the hashes alone. the counts are kept with the distinct hashes as
+// they are merged (HashCounts), and stop at 2^32 - 1
+bool track_abundance = false;
+
+
+
+// sourmash: round((2^64 - 1) / scaled), computed in double precision
+hash_t max_hash_for_scaled(hash_t scaled) {
+    double max_hash = round((double)UINT64_MAX / scaled);
+    if (max_hash >= 18446744073709551615.0) {
+        return UINT64_MAX;
+    }
+    return (hash_t)max_hash;
+}
+
+
+
+// md5 of the sketch as sourmash computes it: the k-mer size, then every hash in ascending order, as decimal text
+class MD5 {
+public:
+    void update(const string& s) {
+        for (unsigned char c : s) {
+            block[block_size++] = c;
+            if (block_size == 64) {
+                transform();
+                block_size = 0;
+            }
+        }
+        total_bytes += s.size();
+    }
+
+    string hex_digest() {
+        uint64_t total_bits = total_bytes * 8;
+        update(string(1, (char)0x80));
+        while (block_size != 56) {
+            update(string(1, '\0'));
+        }
+        for (int i = 0; i < 8; i++) {
+            block[56 + i] = (total_bits >> (8 * i)) & 0xff;
+        }
+        transform();
+
+        const char* digits = "0123456789abcdef";
+        string hex;
+        for (uint32_t v : state) {
+            for (int i = 0; i < 4; i++) {
+                unsigned char byte = (v >> (8 * i)) & 0xff;
+                hex += digits[byte >> 4];
+                hex += digits[byte & 15];
+            }
+        }
+        return hex;
+    }
+
+private:
+    void transform() {
+        static const uint32_t K[64] = {
+            0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+            0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+            0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+            0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+            0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+            0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+            0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+            0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+        static const int R[64] = {
+            7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+            5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+            4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+            6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+        uint32_t M[16];
+        for (int i = 0; i < 16; i++) {
+            M[i] = block[4 * i] | (block[4 * i + 1] << 8) | (block[4 * i + 2] << 16) | ((uint32_t)block[4 * i + 3] << 24);
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        for (int i = 0; i < 64; i++) {
+            uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+            uint32_t rotated = a + f + K[i] + M[g];
+            a = d;
+            d = c;
+            c = b;
+            b = b + ((rotated << R[i]) | (rotated >> (32 - R[i])));
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+    }
+
+    uint32_t state[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    unsigned char block[64];
+    size_t block_size = 0;
+    uint64_t total_bytes = 0;
+};
+
+
+
+// hash a batch of canonical k-mers and keep the hashes under max_hash. with K fixed at compile time the
+// batch goes through the multi-lane kernel; K = 0 hashes one k-mer at a time with the runtime k
+template <int K>
+void hash_batch(const char* const* kmers, int batch_size, int k, uint32_t seed, vector<hash_t>& hashes) {
+    if constexpr (K > 0) {
+        uint64_t h1[MurmurLanes::LANES];
+        uint64_t h2[MurmurLanes::LANES];
+        MurmurHash3_x64_128_lanes<K>(kmers, seed, h1, h2);
+        for (int lane = 0; lane < batch_size; lane++) {
+            if (h1[lane] <= max_hash) {
+                hashes.push_back(h1[lane]);
+            }
+        }
+    } else {
+        for (int lane = 0; lane < batch_size; lane++) {
+            uint64_t out[2];
+            MurmurHash3_x64_128(kmers[lane], k, seed, out);
+            if (out[0] <= max_hash) {
+                hashes.push_back(out[0]);
+            }
+        }
+    }
+}
+
+
+
+// a block of bases prepared once for every k-mer size and seed: the 2-bit code of every base (A=0, C=1, G=2,
+// T=3, and 4 for anything else), and for the hash the bases in upper case and the reverse complement of the
+// whole block, so the k-mer ending at i pairs with rc[n-1-i .. n-1-i+k). bases other than ACGT become 0
+struct CanonicalBlock {
+    int n = 0;
+    vector<uint8_t> code;
+    string seq;
+    string rc;
+};
+
+struct BaseCodes {
+    uint8_t code[256];
+    BaseCodes() {
+        memset(code, 4, sizeof(code));
+        code['A'] = code['a'] = 0;
+        code['C'] = code['c'] = 1;
+        code['G'] = code['g'] = 2;
+        code['T'] = code['t'] = 3;
+    }
+};
+const BaseCodes base_codes;
+
+void prepare_block(const char* sequence, int n, CanonicalBlock& block) {
+    static const char bases[5] = {'A', 'C', 'G', 'T', 0};
+    static const char complements[5] = {'T', 'G', 'C', 'A', 0};
+    block.n = n;
+    block.code.resize(n);
+    block.seq.resize(n);
+    block.rc.resize(n);
+    for (int i = 0; i < n; i++) {
+        uint8_t code = base_codes.code[(unsigned char)sequence[i]];
+        block.code[i] = code;
+        block.seq[i] = bases[code];
+        block.rc[n - 1 - i] = complements[code];
+    }
+}
+
+
+
+// the 2-bit codes of the last k bases and of their reverse complement, each updated in O(1) per base with
+// the first base in the highest bits. for k-mers of one size the order of the codes is the lexicographic
+// order of the bases, so the canonical k-mer is the forward one when its code is not larger
+template <typename Word>
+struct RollingKmer {
+    Word forward = 0;
+    Word reverse = 0;
+    Word mask;
+    int shift;
+
+    RollingKmer(int k) : mask(k * 2 == sizeof(Word) * 8 ? ~Word(0) : (Word(1) << (2 * k)) - 1), shift(2 * (k - 1)) {}
+
+    void push(uint8_t code) {
+        forward = ((forward << 2) | code) & mask;
+        reverse = (reverse >> 2) | (Word(3 - code) << shift);
+    }
+
+    bool forward_is_canonical() const {
+        return forward <= reverse;
+    }
+};
+
+
+
+// add the hashes under max_hash of the canonical k-mers of the block that end at or after position `from`.
+// the orientation comes from a rolling code in Word (64 bits up to k = 32, 128 up to k = 64), or for longer
+// k-mers from comparing the bases; only then are the bytes of the chosen strand handed to the hash
+template <int K, typename Word>
+void add_kmers_k(const CanonicalBlock& block, int from, int k, uint32_t seed, vector<hash_t>& hashes) {
+    if constexpr (K > 0) {
+        k = K;
+    }
+    const int n = block.n;
+    const uint8_t* code = block.code.data();
+    const char* batch[MurmurLanes::LANES];
+    int batch_size = 0;
+
+    // the k-1 bases before `from` start the rolling codes; run counts the ACGT bases in a row
+    RollingKmer<conditional_t<is_void<Word>::value, uint64_t, Word>> rolling(is_void<Word>::value ? 1 : k);
+    int run = 0;
+    for (int i = max(0, from - k + 1); i < n; i++) {
+        run = code[i] < 4 ? run + 1 : 0;
+        if constexpr (!is_void<Word>::value) {
+            rolling.push(code[i] & 3);
+        }
+        if (run < k || i < from) {
+            continue;
+        }
+        const char* kmer = block.seq.data() + i + 1 - k;
+        const char* kmer_rc = block.rc.data() + n - 1 - i;
+        bool forward;
+        if constexpr (is_void<Word>::value) {
+            forward = memcmp(kmer, kmer_rc, k) <= 0;
+        } else {
+            forward = rolling.forward_is_canonical();
+        }
+        batch[batch_size++] = forward ? kmer : kmer_rc;
+        if (batch_size == MurmurLanes::LANES) {
+            hash_batch<K>(batch, batch_size, k, seed, hashes);
+            batch_size = 0;
+        }
+    }
+
+    // a partial batch repeats its first k-mer in the unused lanes
+    if (batch_size > 0) {
+        for (int lane = batch_size; lane < MurmurLanes::LANES; lane++) {
+            batch[lane] = batch[0];
+        }
+        hash_batch<K>(batch, batch_size, k, seed, hashes);
+    }
+}
+
+
+
+// the common k-mer sizes get a kernel specialised for them
+void add_kmers(const CanonicalBlock& block, int from, int k, uint32_t seed, vector<hash_t>& hashes) {
+    switch (k) {
+        case 21: add_kmers_k<21, uint64_t>(block, from, k, seed, hashes); break;
+        case 31: add_kmers_k<31, uint64_t>(block, from, k, seed, hashes); break;
+        case 51: add_kmers_k<51, unsigned __int128>(block, from, k, seed, hashes); break;
+        default:
+            if (k <= 32) {
+                add_kmers_k<0, uint64_t>(block, from, k, seed, hashes);
+            } else if (k <= 64) {
+                add_kmers_k<0, unsigned __int128>(block, from, k, seed, hashes);
+            } else {
+                add_kmers_k<0, void>(block, from, k, seed, hashes);
+            }
+    }
+}
+
+
+
+// one signature per (k-mer size, seed), in the order of sketch_params, all in one file like sourmash writes
+// a sketch with several parameters
+void write_signature(const string& filename, const string& genome_file, const string& name, const vector<vector<hash_t>>& hashes,
+                     const vector<vector<uint32_t>>& abundances) {
+    json sig = json::array();
+    for (int p = 0; p < sketch_params.size(); p++) {
+        MD5 md5;
+        md5.update(to_string(sketch_params[p].ksize));
+        for (hash_t hash : hashes[p]) {
+            md5.update(to_string(hash));
+        }
+
+        json signature = {
+            {"num", 0},
+            {"ksize", sketch_params[p].ksize},
+            {"seed", sketch_params[p].seed},
+            {"max_hash", max_hash},
+            {"mins", hashes[p]},
+            {"md5sum", md5.hex_digest()}};
+        if (track_abundance) {
+            signature["abundances"] = abundances[p];
+        }
+        signature["molecule"] = "DNA";
+        sig.push_back({
+            {"class", "sourmash_signature"},
+            {"email", ""},
+            {"hash_function", "0.murmur64"},
+            {"filename", genome_file},
+            {"name", name},
+            {"license", "CC0"},
+            {"signatures", json::array({signature})},
+            {"version", 0.4}});
+    }
+    string text = sig.dump();
+
+    gzFile file = gzopen(filename.c_str(), gzip_output ? "wb6" : "wbT");
+    if (!file) {
+        cerr << "Could not open the file: " << filename << endl;
+        exit(1);
+    }
+    // a full disk must not leave a truncated sketch behind a successful run
+    string error;
+    if (gzwrite(file, text.data(), text.size()) != (int)text.size()) {
+        int errnum;
+        error = gzerror(file, &errnum);
+        if (errnum == Z_ERRNO) {
+            error = strerror(errno);
+        }
+    }
+    if (gzclose(file) != Z_OK && error.empty()) {
+        error = strerror(errno);
+    }
+    if (!error.empty()) {
+        cerr << "Failed to write the file: " << filename << ": " << error << endl;
+        exit(1);
+    }
+}
+
+
+
+// the hashes kept so far for one (k-mer size, seed): distinct and sorted, with how often each occurred, plus the
+// hashes of the latest blocks, which are merged in once they pass MAX_PENDING. memory follows the size of the
+// sketch, not the size of the input times its coverage
+struct HashCounts {
+    static const size_t MAX_PENDING = 1 << 22;
+    vector<hash_t> hashes;
+    vector<uint32_t> counts;
+    vector<hash_t> pending;
+
+    void merge_pending() {
+        if (pending.empty()) {
+            return;
+        }
+        sort(pending.begin(), pending.end());
+        vector<hash_t> merged_hashes;
+        vector<uint32_t> merged_counts;
+        merged_hashes.reserve(hashes.size() + pending.size());
+        merged_counts.reserve(hashes.size() + pending.size());
+        size_t a = 0, b = 0;
+        while (a < hashes.size() || b < pending.size()) {
+            hash_t hash = (b == pending.size() || (a < hashes.size() && hashes[a] <= pending[b])) ? hashes[a] : pending[b];
+            uint64_t count = 0;
+            if (a < hashes.size() && hashes[a] == hash) {
+                count = counts[a++];
+            }
+            for (; b < pending.size() && pending[b] == hash; b++) {
+                count++;
+            }
+            merged_hashes.push_back(hash);
+            merged_counts.push_back((uint32_t)min<uint64_t>(count, UINT32_MAX));
+        }
+        hashes.swap(merged_hashes);
+        counts.swap(merged_counts);
+        pending.clear();
+    }
+};
+
+
+
+void sketch_one_genome(int i) {
+    // records are read block by block, each block prepared once and hashed for every k-mer size and seed.
+    // blocks overlap by the largest k minus 1; every size hashes only the k-mers that end in the new bases
+    int max_ksize = 0;
+    for (const auto& params : sketch_params) {
+        max_ksize = max(max_ksize, params.ksize);
+    }
+    vector<HashCounts> sketches(sketch_params.size());
+    CanonicalBlock block;
+    string first_name, name;
+    bool first = true;
+    for (const auto& genome_file : genome_files[i]) {
+        SequenceReader reader(genome_file, inflate_threads);
+        while (reader.next_record(name)) {
+            if (first) {
+                first_name = name;
+                first = false;
+            }
+            for_each_block(reader, max_ksize - 1, [&](const char* bases, size_t length, size_t carried) {
+                prepare_block(bases, length, block);
+                for (int p = 0; p < sketch_params.size(); p++) {
+                    add_kmers(block, carried, sketch_params[p].ksize, sketch_params[p].seed, sketches[p].pending);
+                    if (sketches[p].pending.size() >= HashCounts::MAX_PENDING) {
+                        sketches[p].merge_pending();
+                    }
+                }
+            });
+        }
+    }
+    vector<vector<hash_t>> hashes(sketch_params.size());
+    vector<vector<uint32_t>> abundances(sketch_params.size());
+    for (int p = 0; p < sketch_params.size(); p++) {
+        sketches[p].merge_pending();
+        hashes[p] = std::move(sketches[p].hashes);
+        if (track_abundance) {
+            abundances[p] = std::move(sketches[p].counts);
+        }
+    }
+    write_signature(sketch_files[i], genome_files[i][0], first_name, hashes, abundances);
+}
+
+
+
+// comma separated numbers
+vector<unsigned long long> parse_list(const string& text) {
+    vector<unsigned long long> values;
+    stringstream ss(text);
+    string value;
+    while (getline(ss, value, ',')) {
+        values.push_back(stoull(value));
+    }
+    return values;
+}
+
+
+
+int main(int argc, char* argv[]) {
+
+    // command line arguments: genome list, output directory, number of threads, then options
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " <genome_list> <out_dir> <num_threads> [options]" << endl;
+        cerr << "  genome_list: one FASTA/FASTQ file per line, optionally gzip-compressed; one sketch per line. a line may" << endl;
+        cerr << "               list several files separated by commas (the FASTQ files of a sample), sketched together" << endl;
+        cerr << "  --ksize K[,K...]  k-mer sizes (default 31)" << endl;
+        cerr << "  --scaled S        keep hashes up to 2^64/S (default 1000)" << endl;
+        cerr << "  --seed N[,N...]   hash seeds (default 42, as sourmash)" << endl;
+        cerr << "  every (k-mer size, seed) pair becomes one signature of the genome's file, in the order given;" << endl;
+        cerr << "  the tools that read sketches use the first one" << endl;
+        cerr << "  --track-abundance write how often each kept hash occurs (\"abundances\")" << endl;
+        cerr << "  --gzip            write .sig.gz instead of .sig" << endl;
+        cerr << "  --inflate-threads N" << endl;
+        cerr << "                    threads inflating each input while it is sketched (default 1); BGZF files (bgzip)" << endl;
+        cerr << "                    are inflated by all N in parallel, others by one. 0 inflates on the sketching thread" << endl;
+        cerr << "  the sketch paths are listed in <out_dir>/sketch_list.txt, the file list compute_by_all_hashes takes" << endl;
+        return 1;
+    }
+
+    string genome_list = argv[1];
+    out_dir = argv[2];
+    vector<unsigned long long> ksizes = {31};
+    vector<unsigned long long> seeds = {42};
+    num_threads = stoi(argv[3]);
+    for (int i = 4; i < argc; i++) {
+        string option = argv[i];
+        if (option == "--ksize" && i + 1 < argc) {
+            ksizes = parse_list(argv[++i]);
+        } else if (option == "--scaled" && i + 1 < argc) {
+            scaled = stoull(argv[++i]);
+        } else if (option == "--seed" && i + 1 < argc) {
+            seeds = parse_list(argv[++i]);
+        } else if (option == "--track-abundance") {
+            track_abundance = true;
+        } else if (option == "--inflate-threads" && i + 1 < argc) {
+            inflate_threads = stoi(argv[++i]);
+        } else if (option == "--gzip") {
+            gzip_output = true;
+        } else {
+            cerr << "Unknown option: " << option << endl;
+            return 1;
+        }
+    }
+    max_hash = max_hash_for_scaled(scaled);
+    for (auto ksize : ksizes) {
+        if (ksize < 8) {
+            cerr << "k-mer sizes below 8 are not supported" << endl;
+            return 1;
+        }
+        for (auto seed : seeds) {
+            sketch_params.push_back({(int)ksize, (uint32_t)seed});
+        }
+    }
+
+    ifstream file(genome_list);
+    if (!file.is_open()) {
+        cerr << "Could not open the file: " << genome_list << endl;
+        return 1;
+    }
+    string line;
+    while (getline(file, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        vector<string> files;
+        stringstream ss(line);
+        string filename;
+        while (getline(ss, filename, ',')) {
+            if (!filename.empty()) {
+                files.push_back(filename);
+            }
+        }
+        genome_files.push_back(files);
+    }
+    file.close();
+
+    // sketch names: the (first) genome file name, without directories. two genomes with the same file name
+    // in different directories would overwrite each other's sketch
+    unordered_map<string, int> sketch_file_owner;
+    for (int i = 0; i < genome_files.size(); i++) {
+        string base = genome_files[i][0].substr(genome_files[i][0].find_last_of('/') + 1);
+        sketch_files.push_back(out_dir + "/" + base + (gzip_output ? ".sig.gz" : ".sig"));
+        auto inserted = sketch_file_owner.insert({sketch_files[i], i});
+        if (!inserted.second) {
+            cerr << "Both " << genome_files[inserted.first->second][0] << " and " << genome_files[i][0] << " would be sketched to " << sketch_files[i] << endl;
+            return 1;
+        }
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+
+    // one genome per task; threads take the next genome when done
+    atomic<int> next_genome(0);
+    vector<thread> threads;
+    for (int t = 0; t < num_threads; t++) {
+        threads.push_back(thread([&]() {
+            for (int i = next_genome++; i < (int)genome_files.size(); i = next_genome++) {
+                // a missing or corrupt input ends the run; the message names the file
+                try {
+                    sketch_one_genome(i);
+                } catch (const exception& e) {
+                    cerr << e.what() << endl;
+                    exit(1);
+                }
+            }
+        }));
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+
+    ofstream list_file(out_dir + "/sketch_list.txt");
+    for (const auto& sketch_file : sketch_files) {
+        list_file << sketch_file << '\n';
+    }
+    list_file.close();
+    if (!list_file) {
+        cerr << "Failed to write the file: " << out_dir + "/sketch_list.txt" << endl;
+        return 1;
+    }
+
+    auto end = chrono::high_resolution_clock::now();
+    cout << "Sketched " << genome_files.size() << " genomes in " << chrono::duration_cast<chrono::milliseconds>(end - start).count() << " milliseconds" << endl;
+
+    return 0;
+}
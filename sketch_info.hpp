@@ -0,0 +1,74 @@
+#ifndef SKETCH_INFO_HPP
+#define SKETCH_INFO_HPP
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Reading the sketch_info.tsv sidecar written by compute_by_all_hashes, shared by the tools that take the
+// sketch sizes from it instead of parsing every sketch. The first line is a tab-separated header, then one
+// line per sketch, in the order of the sketch list.
+
+
+inline std::vector<std::string> split_tabs(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t end = line.find('\t', start);
+        fields.push_back(line.substr(start, end - start));
+        if (end == std::string::npos) {
+            return fields;
+        }
+        start = end + 1;
+    }
+}
+
+
+// the sizes in the num_hashes column, found by name. the sidecar must list exactly num_sketches sketches,
+// and every size must be a non-negative integer; anything else is an error
+inline std::vector<int> read_sketch_info(const std::string& filename, int num_sketches) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cerr << "Could not open the file: " << filename << std::endl;
+        exit(1);
+    }
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    file.close();
+
+    std::vector<std::string> header = lines.empty() ? std::vector<std::string>() : split_tabs(lines[0]);
+    size_t column = std::find(header.begin(), header.end(), "num_hashes") - header.begin();
+    if (column == header.size()) {
+        std::cerr << filename << " has no num_hashes column" << std::endl;
+        exit(1);
+    }
+    if ((long long)lines.size() != (long long)num_sketches + 1) {
+        std::cerr << filename << " lists " << (long long)lines.size() - 1 << " sketches, the sketch list " << num_sketches << std::endl;
+        exit(1);
+    }
+
+    std::vector<int> sizes(num_sketches);
+    for (int i = 0; i < num_sketches; i++) {
+        std::vector<std::string> fields = split_tabs(lines[i + 1]);
+        char* end = nullptr;
+        errno = 0;
+        long size = column < fields.size() ? strtol(fields[column].c_str(), &end, 10) : -1;
+        if (column >= fields.size() || fields[column].empty() || *end != '\0' || errno != 0 || size < 0 || size > INT32_MAX) {
+            std::cerr << filename << ", line " << i + 2 << ": not a sketch size: " << lines[i + 1] << std::endl;
+            exit(1);
+        }
+        sizes[i] = size;
+    }
+    return sizes;
+}
+
+
+#endif
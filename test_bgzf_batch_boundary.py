@@ -0,0 +1,86 @@
+import argparse
+import json
+import os
+import random
+import struct
+import subprocess
+import sys
+import tempfile
+import zlib
+
+# sketch_genomes inflates BGZF files in batches of 64 members. this test writes the same genome as plain FASTA and as
+# BGZF with 63, 64 and 65 data members, so the 28-byte EOF member ends a batch, starts one on its own, or follows
+# another member, and checks that every BGZF sketch has the hashes of the plain one
+
+MEMBERS_PER_BATCH = 64
+
+
+def parse_args():
+    # arguments: the sketch_genomes binary
+    parser = argparse.ArgumentParser(description='Test BGZF inputs whose EOF member falls on a batch boundary')
+    parser.add_argument('sketch_genomes', help='Path to the sketch_genomes binary')
+    parser.add_argument('--inflate_threads', type=int, default=2)
+    return parser.parse_args()
+
+
+def bgzf_member(data):
+    # a gzip member with the BC extra field holding the member size minus 1; empty data gives the EOF member
+    compressor = zlib.compressobj(6, zlib.DEFLATED, -15)
+    deflated = compressor.compress(data) + compressor.flush()
+    block_size = 18 + len(deflated) + 8
+    header = b'\x1f\x8b\x08\x04\x00\x00\x00\x00\x00\xff' + struct.pack('<H', 6) + b'BC' + struct.pack('<HH', 2, block_size - 1)
+    footer = struct.pack('<II', zlib.crc32(data) & 0xffffffff, len(data))
+    return header + deflated + footer
+
+
+def write_bgzf(filename, text, num_members):
+    chunk_size = -(-len(text) // num_members)
+    with open(filename, 'wb') as f:
+        for i in range(num_members):
+            f.write(bgzf_member(text[i * chunk_size:(i + 1) * chunk_size]))
+        f.write(bgzf_member(b''))
+
+
+def sketch_hashes(sketch_genomes, genome_file, out_dir, inflate_threads):
+    genome_list = os.path.join(out_dir, 'genomes.txt')
+    with open(genome_list, 'w') as f:
+        f.write(genome_file + '\n')
+    subprocess.run([sketch_genomes, genome_list, out_dir, '1', '--scaled', '10', '--inflate-threads', str(inflate_threads)],
+                   check=True, stdout=subprocess.DEVNULL)
+    with open(os.path.join(out_dir, os.path.basename(genome_file) + '.sig')) as f:
+        return json.load(f)[0]['signatures'][0]['mins']
+
+
+def main():
+    args = parse_args()
+    random.seed(1)
+    lines = ['>genome']
+    for _ in range(MEMBERS_PER_BATCH * 10):
+        lines.append(''.join(random.choice('ACGT') for _ in range(80)))
+    text = ('\n'.join(lines) + '\n').encode()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        plain_file = os.path.join(tmp, 'genome.fa')
+        with open(plain_file, 'wb') as f:
+            f.write(text)
+        os.mkdir(os.path.join(tmp, 'plain'))
+        expected = sketch_hashes(args.sketch_genomes, plain_file, os.path.join(tmp, 'plain'), 0)
+
+        failed = False
+        for num_members in [MEMBERS_PER_BATCH - 1, MEMBERS_PER_BATCH, MEMBERS_PER_BATCH + 1]:
+            bgzf_file = os.path.join(tmp, 'genome_%d.fa.gz' % num_members)
+            write_bgzf(bgzf_file, text, num_members)
+            out_dir = os.path.join(tmp, 'bgzf_%d' % num_members)
+            os.mkdir(out_dir)
+            hashes = sketch_hashes(args.sketch_genomes, bgzf_file, out_dir, args.inflate_threads)
+            agrees = hashes == expected
+            failed = failed or not agrees
+            print('%d data members: %s' % (num_members, 'ok' if agrees else 'hashes differ from the plain file'))
+
+    if failed:
+        sys.exit(1)
+    print('All tests passed')
+
+
+if __name__ == '__main__':
+    main()
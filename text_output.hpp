@@ -0,0 +1,279 @@
+#ifndef TEXT_OUTPUT_HPP
+#define TEXT_OUTPUT_HPP
+
+#include <cerrno>
+#include <charconv>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <zlib.h>
+
+// Output engine shared by the tools: values are formatted with std::to_chars into a large buffer,
+// and full buffers are handed to a writer thread, so formatting never waits on write(2).
+
+
+// precision of iostream's default double formatting; with it the output is byte-identical to `ofstream <<`
+const int DEFAULT_TEXT_PRECISION = 6;
+
+
+// writes buffers on a background thread, gzip-compressing them if asked, so the caller can fill
+// the next buffer while the previous one is compressed and written. at most max_pending buffers are queued.
+// a failed write (a full disk, a quota) ends the run with a message and exit code 1, at the next write() or
+// at close(), so a truncated output is never taken for a complete one
+class BackgroundFileWriter {
+public:
+    BackgroundFileWriter(const std::string& filename, bool gzip_output, size_t max_pending = 4)
+        : filename(filename), gzip_output(gzip_output), max_pending(max_pending) {
+        if (gzip_output) {
+            gz_file = gzopen(filename.c_str(), "wb6");
+        } else {
+            file = fopen(filename.c_str(), "wb");
+        }
+        if (!file && !gz_file) {
+            throw std::runtime_error("Failed to open output file: " + filename);
+        }
+        writer = std::thread(&BackgroundFileWriter::run, this);
+    }
+
+    ~BackgroundFileWriter() {
+        close();
+    }
+
+    void write(std::vector<char>&& buffer) {
+        std::unique_lock<std::mutex> lock(mtx);
+        not_full.wait(lock, [this]() { return pending.size() < max_pending; });
+        if (!error.empty()) {
+            fail(error);
+        }
+        pending.push(std::move(buffer));
+        not_empty.notify_one();
+    }
+
+    // wait for all queued buffers to be written, then close the file
+    void close() {
+        if (!writer.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            done = true;
+        }
+        not_empty.notify_one();
+        writer.join();
+        bool closed = gzip_output ? gzclose(gz_file) == Z_OK : fclose(file) == 0;
+        if (!closed && error.empty()) {
+            error = "Failed to write output file: " + filename + ": " + strerror(errno);
+        }
+        if (!error.empty()) {
+            fail(error);
+        }
+    }
+
+private:
+    static void fail(const std::string& message) {
+        std::cerr << message << std::endl;
+        std::exit(1);
+    }
+
+    void run() {
+        while (true) {
+            std::vector<char> buffer;
+            {
+                std::unique_lock<std::mutex> lock(mtx);
+                not_empty.wait(lock, [this]() { return done || !pending.empty(); });
+                if (pending.empty()) {
+                    return;
+                }
+                buffer = std::move(pending.front());
+                pending.pop();
+            }
+            not_full.notify_one();
+            if (buffer.empty() || !error.empty()) {
+                continue;
+            }
+            // after the first error the rest is dropped, the error is reported to the caller
+            bool written;
+            if (gzip_output) {
+                written = gzwrite(gz_file, buffer.data(), buffer.size()) == (int)buffer.size();
+            } else {
+                written = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+            }
+            if (!written) {
+                int errnum = Z_OK;
+                std::string reason = gzip_output ? gzerror(gz_file, &errnum) : strerror(errno);
+                if (errnum == Z_ERRNO) {
+                    reason = strerror(errno);
+                }
+                std::lock_guard<std::mutex> lock(mtx);
+                error = "Failed to write output file: " + filename + ": " + reason;
+            }
+        }
+    }
+
+    std::string filename;
+    bool gzip_output;
+    size_t max_pending;
+    FILE* file = nullptr;
+    gzFile gz_file = nullptr;
+    std::queue<std::vector<char>> pending;
+    std::mutex mtx;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    bool done = false;
+    // the first failed write, set by the writer thread under mtx
+    std::string error;
+    std::thread writer;
+};
+
+
+// a text file written through a private formatting buffer, used like an ofstream:
+//     out << i << ',' << j << ',' << jaccard << '\n';
+// floating point values are written like printf("%.<precision>g"). not thread-safe: one per thread.
+// constructed without a file name, it only formats into memory and the text is collected with take()
+class TextWriter {
+public:
+    static const size_t DEFAULT_BUFFER_SIZE = 4 << 20;
+
+    TextWriter(const std::string& filename, int precision = DEFAULT_TEXT_PRECISION, bool gzip_output = false, size_t buffer_size = DEFAULT_BUFFER_SIZE)
+        : writer(new BackgroundFileWriter(filename, gzip_output)), precision(precision), buffer_size(buffer_size) {
+        buffer.reserve(buffer_size);
+    }
+
+    explicit TextWriter(int precision = DEFAULT_TEXT_PRECISION)
+        : precision(precision), buffer_size(DEFAULT_BUFFER_SIZE) {
+    }
+
+    // the text formatted so far, for in-memory writers
+    std::vector<char> take() {
+        return std::move(buffer);
+    }
+
+    ~TextWriter() {
+        close();
+    }
+
+    TextWriter& operator<<(char c) {
+        buffer.push_back(c);
+        return check_flush();
+    }
+
+    TextWriter& operator<<(const char* s) {
+        buffer.insert(buffer.end(), s, s + strlen(s));
+        return check_flush();
+    }
+
+    TextWriter& operator<<(const std::string& s) {
+        buffer.insert(buffer.end(), s.begin(), s.end());
+        return check_flush();
+    }
+
+    TextWriter& operator<<(std::string_view s) {
+        buffer.insert(buffer.end(), s.begin(), s.end());
+        return check_flush();
+    }
+
+    TextWriter& operator<<(int value) { return append_integer(value); }
+    TextWriter& operator<<(unsigned int value) { return append_integer(value); }
+    TextWriter& operator<<(long value) { return append_integer(value); }
+    TextWriter& operator<<(unsigned long value) { return append_integer(value); }
+    TextWriter& operator<<(long long value) { return append_integer(value); }
+    TextWriter& operator<<(unsigned long long value) { return append_integer(value); }
+
+    TextWriter& operator<<(double value) {
+        char digits[64];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, precision);
+        buffer.insert(buffer.end(), digits, result.ptr);
+        return check_flush();
+    }
+
+    TextWriter& operator<<(float value) {
+        return *this << (double)value;
+    }
+
+    // hand the buffered text to the writer thread
+    void flush() {
+        if (writer && !buffer.empty()) {
+            writer->write(std::move(buffer));
+            buffer = std::vector<char>();
+            buffer.reserve(buffer_size);
+        }
+    }
+
+    void close() {
+        if (writer) {
+            flush();
+            writer->close();
+        }
+    }
+
+private:
+    template <typename T>
+    TextWriter& append_integer(T value) {
+        char digits[24];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        buffer.insert(buffer.end(), digits, result.ptr);
+        return check_flush();
+    }
+
+    TextWriter& check_flush() {
+        if (writer && buffer.size() >= buffer_size) {
+            flush();
+        }
+        return *this;
+    }
+
+    std::unique_ptr<BackgroundFileWriter> writer;
+    int precision;
+    size_t buffer_size;
+    std::vector<char> buffer;
+};
+
+
+
+// all strings of a column (genome names, md5s) in one buffer, each CSV-quoted once when added,
+// so rows copy them straight from the table without building a string per row
+class StringTable {
+public:
+    void add(const std::string& s) {
+        offsets.push_back(data.size());
+        if (s.find_first_of(",\"\r\n") == std::string::npos) {
+            data += s;
+        } else {
+            data += '"';
+            for (char c : s) {
+                if (c == '"') {
+                    data += '"';
+                }
+                data += c;
+            }
+            data += '"';
+        }
+        ends.push_back(data.size());
+    }
+
+    std::string_view operator[](size_t i) const {
+        return std::string_view(data.data() + offsets[i], ends[i] - offsets[i]);
+    }
+
+    size_t size() const {
+        return offsets.size();
+    }
+
+private:
+    std::string data;
+    std::vector<size_t> offsets;
+    std::vector<size_t> ends;
+};
+
+#endif
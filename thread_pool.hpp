@@ -0,0 +1,91 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+#include "eigen/unsupported/Eigen/CXX11/ThreadPool"
+
+// One set of worker threads for a whole run, on Eigen's non-blocking work-stealing pool: every stage submits
+// tasks to the same pool instead of starting and joining threads of its own, and waits only for the tasks
+// whose results it needs. Tasks must not wait for other tasks of the pool.
+//
+//     Eigen::ThreadPool pool(num_threads);
+//     run_tasks(pool, num_files, [&](int f) { ... });
+//     parallel_for(pool, n, [&](long long i) { ... });
+//
+// stages that do not depend on each other submit to one TaskGroup and wait once, so they run at the same time
+
+
+// fn(task) for every task in [0, num_tasks), in any order; returns when all are done
+template <typename Fn>
+void run_tasks(Eigen::ThreadPool& pool, int num_tasks, Fn fn) {
+    if (num_tasks <= 0) {
+        return;
+    }
+    Eigen::Barrier barrier(num_tasks);
+    for (int task = 0; task < num_tasks; task++) {
+        pool.Schedule([&, task]() {
+            fn(task);
+            barrier.Notify();
+        });
+    }
+    barrier.Wait();
+}
+
+
+// fn(i) for every i in [0, n), in tasks_per_thread ranges per worker, so the workers that finish early take
+// the ranges left instead of waiting for the slowest one
+template <typename Fn>
+void parallel_for(Eigen::ThreadPool& pool, long long n, Fn fn, int tasks_per_thread = 4) {
+    int num_tasks = (int)std::min<long long>(n, (long long)pool.NumThreads() * tasks_per_thread);
+    run_tasks(pool, num_tasks, [&](int task) {
+        long long start_index = n * task / num_tasks;
+        long long end_index = n * (task + 1) / num_tasks;
+        for (long long i = start_index; i < end_index; i++) {
+            fn(i);
+        }
+    });
+}
+
+
+// tasks submitted one at a time, by one or several stages, and waited for together
+class TaskGroup {
+public:
+    TaskGroup(Eigen::ThreadPool& pool) : pool(pool) {}
+
+    ~TaskGroup() {
+        wait();
+    }
+
+    template <typename Fn>
+    void run(Fn fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending++;
+        }
+        pool.Schedule([this, fn]() {
+            fn();
+            // the count only changes under the lock, so wait() cannot return while a task still uses the group
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0) {
+                done.notify_all();
+            }
+        });
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return pending == 0; });
+    }
+
+private:
+    Eigen::ThreadPool& pool;
+    std::mutex mutex;
+    std::condition_variable done;
+    long long pending = 0;
+};
+
+#endif